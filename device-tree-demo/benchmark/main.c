@@ -0,0 +1,337 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/gpio.h>
+#include <getopt.h>
+
+#include "../device-tree-demo.h"
+
+static void usage(void)
+{
+    printf ("\ngpio-benchmark [OPTIONS...]\n\n"
+            "Measure how fast a GPIO can be toggled through different interfaces.\n"
+            "Only the interfaces given on the command line are measured, the\n"
+            "result is printed as CSV to stdout.\n\n"
+            "  -s sysfs attribute of the demo driver (e.g. /sys/devices/platform/demo/demo_gpio)\n"
+            "  -d character device of the demo driver (e.g. /dev/demo), measures the\n"
+            "     batched ioctl and the mmap'd waveform ring\n"
+            "  -c GPIO chip character device (e.g. /dev/gpiochip0)\n"
+            "  -l line offset on the GPIO chip (default 0)\n"
+            "  -n number of edges per interface (default 10000)\n"
+            "  -H do not print the CSV header\n"
+            "  -h show this message\n\n");
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const uint64_t *sorted, unsigned int n, unsigned int p)
+{
+    return sorted[(uint64_t)(n - 1) * p / 100];
+}
+
+/* Print one CSV line, latencies may be NULL if they can not be measured per edge */
+static void report(const char *method, unsigned int edges, uint64_t total_ns,
+                   uint64_t *latencies)
+{
+    double seconds = total_ns / 1e9;
+
+    printf("%s,%u,%.6f,%.0f", method, edges, seconds, edges / seconds);
+    if (latencies) {
+        qsort(latencies, edges, sizeof(*latencies), compare_u64);
+        printf(",%llu,%llu,%llu,%llu\n",
+               (unsigned long long)percentile(latencies, edges, 50),
+               (unsigned long long)percentile(latencies, edges, 90),
+               (unsigned long long)percentile(latencies, edges, 99),
+               (unsigned long long)latencies[edges - 1]);
+    } else {
+        printf(",,,,\n");
+    }
+    fflush(stdout);
+}
+
+static int bench_sysfs(const char *path, unsigned int edges, uint64_t *latencies)
+{
+    uint64_t start, t;
+    int fd = open(path, O_WRONLY);
+
+    if (fd < 0) {
+        fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    start = now_ns();
+    for (unsigned int i = 0; i < edges; i++) {
+        t = now_ns();
+        if (pwrite(fd, (i & 1) ? "1\n" : "0\n", 2, 0) != 2) {
+            fprintf(stderr, "Could not write %s: %s\n", path, strerror(errno));
+            close(fd);
+            return -1;
+        }
+        latencies[i] = now_ns() - t;
+    }
+    report("sysfs", edges, now_ns() - start, latencies);
+
+    close(fd);
+
+    return 0;
+}
+
+static int bench_gpiochip(const char *path, unsigned int line, unsigned int edges,
+                          uint64_t *latencies)
+{
+    struct gpio_v2_line_request req;
+    struct gpio_v2_line_values values;
+    uint64_t start, t;
+    int fd = open(path, O_RDWR);
+    int ret = -1;
+
+    if (fd < 0) {
+        fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.offsets[0] = line;
+    req.num_lines = 1;
+    req.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+    strncpy(req.consumer, "gpio-benchmark", sizeof(req.consumer) - 1);
+    if (ioctl(fd, GPIO_V2_GET_LINE_IOCTL, &req)) {
+        fprintf(stderr, "Could not request line %u: %s\n", line, strerror(errno));
+        goto out;
+    }
+
+    values.mask = 1;
+    start = now_ns();
+    for (unsigned int i = 0; i < edges; i++) {
+        values.bits = i & 1;
+        t = now_ns();
+        if (ioctl(req.fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values)) {
+            fprintf(stderr, "Could not set line %u: %s\n", line, strerror(errno));
+            goto out_line;
+        }
+        latencies[i] = now_ns() - t;
+    }
+    report("gpiochip", edges, now_ns() - start, latencies);
+    ret = 0;
+
+out_line:
+    close(req.fd);
+out:
+    close(fd);
+
+    return ret;
+}
+
+static int bench_demo_ioctl(int fd, unsigned int edges, uint64_t *latencies)
+{
+    struct demo_gpio_values values;
+    uint32_t count;
+    uint64_t start, t;
+
+    if (ioctl(fd, DEMO_GPIO_GET_LINE_COUNT, &count)) {
+        fprintf(stderr, "Could not get line count: %s\n", strerror(errno));
+        return -1;
+    }
+
+    /* All lines toggle with one call */
+    values.mask = count >= 64 ? UINT64_MAX : (1ull << count) - 1;
+    start = now_ns();
+    for (unsigned int i = 0; i < edges; i++) {
+        values.values = (i & 1) ? UINT64_MAX : 0;
+        t = now_ns();
+        if (ioctl(fd, DEMO_GPIO_SET_VALUES, &values)) {
+            fprintf(stderr, "Could not set values: %s\n", strerror(errno));
+            return -1;
+        }
+        latencies[i] = now_ns() - t;
+    }
+    report("demo-ioctl", edges, now_ns() - start, latencies);
+
+    return 0;
+}
+
+static int bench_demo_ring(int fd, unsigned int edges)
+{
+    struct demo_gpio_ring *ring;
+    struct demo_gpio_play_stats stats;
+    uint64_t start, total;
+    unsigned int queued = 0;
+    uint32_t head;
+    int ret = -1;
+
+    ring = mmap(NULL, sizeof(*ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED) {
+        fprintf(stderr, "Could not map ring: %s\n", strerror(errno));
+        return -1;
+    }
+
+    head = ring->head;
+    start = now_ns();
+    while (queued < edges ||
+           __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) != head) {
+        /* Refill whatever the driver already played, as fast as possible */
+        while (queued < edges &&
+               head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) < ring->entries) {
+            struct demo_gpio_cmd *cmd = &ring->cmds[head % ring->entries];
+
+            cmd->mask = UINT64_MAX;
+            cmd->values = (queued & 1) ? UINT64_MAX : 0;
+            cmd->delay_ns = 0;
+            head++;
+            queued++;
+        }
+        __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+
+        if (ioctl(fd, DEMO_GPIO_PLAY_START)) {
+            fprintf(stderr, "Could not start player: %s\n", strerror(errno));
+            goto out;
+        }
+        sched_yield();
+    }
+    total = now_ns() - start;
+
+    if (ioctl(fd, DEMO_GPIO_PLAY_STOP))
+        fprintf(stderr, "Could not stop player: %s\n", strerror(errno));
+
+    report("demo-ring", edges, total, NULL);
+
+    if (!ioctl(fd, DEMO_GPIO_GET_PLAY_STATS, &stats))
+        fprintf(stderr, "demo-ring: %llu commands, %llu underruns, %llu overruns\n",
+                (unsigned long long)stats.commands,
+                (unsigned long long)stats.underruns,
+                (unsigned long long)stats.overruns);
+    ret = 0;
+
+out:
+    munmap(ring, sizeof(*ring));
+
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    char *sysfs_attribute = 0;
+    char *demo_device = 0;
+    char *gpiochip_device = 0;
+    unsigned int line = 0;
+    unsigned int edges = 10000;
+    int header = 1;
+    uint64_t *latencies;
+    int ret = 0;
+    int c;
+
+    opterr = 0;
+    while ((c = getopt (argc, argv, "s:d:c:l:n:Hh")) != -1) {
+        switch (c)
+        {
+        case 's':
+            sysfs_attribute = optarg;
+            break;
+        case 'd':
+            demo_device = optarg;
+            break;
+        case 'c':
+            gpiochip_device = optarg;
+            break;
+        case 'l':
+            sscanf(optarg, "%u", &line);
+            break;
+        case 'n':
+            sscanf(optarg, "%u", &edges);
+            break;
+        case 'H':
+            header = 0;
+            break;
+        case 'h':
+            usage();
+            return 1;
+        default:
+            break;
+        }
+    }
+
+    if (!sysfs_attribute && !demo_device && !gpiochip_device) {
+        printf("Please specify at least one interface\n");
+        usage();
+        return 3;
+    }
+
+    if (edges == 0) {
+        printf("Please specify at least one edge\n");
+        return 3;
+    }
+
+    latencies = calloc(edges, sizeof(*latencies));
+    if (!latencies) {
+        printf("Could not allocate memory\n");
+        return 2;
+    }
+
+    if (header)
+        printf("method,edges,seconds,toggles_per_sec,p50_ns,p90_ns,p99_ns,max_ns\n");
+
+    if (sysfs_attribute && bench_sysfs(sysfs_attribute, edges, latencies))
+        ret = 2;
+
+    if (gpiochip_device && bench_gpiochip(gpiochip_device, line, edges, latencies))
+        ret = 2;
+
+    if (demo_device) {
+        int fd = open(demo_device, O_RDWR);
+
+        if (fd < 0) {
+            fprintf(stderr, "Could not open %s: %s\n", demo_device, strerror(errno));
+            ret = 2;
+        } else {
+            if (bench_demo_ioctl(fd, edges, latencies))
+                ret = 2;
+            if (bench_demo_ring(fd, edges))
+                ret = 2;
+            close(fd);
+        }
+    }
+
+    free(latencies);
+
+    return ret;
+}
@@ -4,35 +4,863 @@
  *
  * Copyright (C) Stefan Eichenberger <stefan@embear.ch>
  */
+#include <linux/bitmap.h>
+#include <linux/fs.h>
+#include <linux/gpio/consumer.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
+#include <linux/kfifo.h>
+#include <linux/kref.h>
+#include <linux/kthread.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/of.h>
 #include <linux/platform_device.h>
-#include <linux/of_gpio.h>
+#include <linux/poll.h>
+#include <linux/rwsem.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+
+#include "device-tree-demo.h"
+
+/* Edges per input line that can be buffered until userspace reads them */
+#define DEMO_GPIO_CAPTURE_FIFO_SIZE 1024
+
+/*
+ * Commands the player applies in one run of the timer. After that, or if a
+ * delay already passed because the schedule fell behind, it runs again
+ * DEMO_GPIO_PLAY_REARM_NS later at the earliest, a ring kept full must not
+ * keep the CPU in hardirq context.
+ */
+#define DEMO_GPIO_PLAY_BATCH 32
+#define DEMO_GPIO_PLAY_REARM_NS (10 * NSEC_PER_USEC)
+
+struct device_tree_demo_driver_data;
+
+struct demo_gpio_input
+{
+	struct device_tree_demo_driver_data *data;
+	struct gpio_desc *desc;
+	unsigned int index;
+	bool can_sleep;
+	/*
+	 * Single producer (the irq handler, or the filter timer if filtering)
+	 * and single consumer, no lock needed
+	 */
+	DECLARE_KFIFO_PTR(fifo, struct demo_gpio_edge);
+	/* Only written by the irq handler */
+	unsigned long edges;
+	/* Only written by the producer */
+	unsigned long overflows;
+	unsigned long filtered;
+
+	/* Software filter, an edge is reported once the line is stable for filter_ns */
+	u64 filter_ns;
+	struct hrtimer filter_timer;
+	/* Protects burst_start_ns and burst_edges */
+	spinlock_t filter_lock;
+	u64 burst_start_ns;
+	unsigned int burst_edges;
+	/* Last reported level, only known if the line does not sleep */
+	int settled_value;
+	/* Only written by the reader, protected by capture_lock */
+	u64 latency_samples;
+	u64 latency_max_ns;
+	u64 latency_total_ns;
+};
 
 struct device_tree_demo_driver_data
 {
-	int gpio;
+	struct device *dev;
+	struct gpio_descs *gpios;
+	struct miscdevice miscdev;
+	/* Every open file holds a reference, the memory outlives the unbind */
+	struct kref ref;
+	/*
+	 * The file operations hold gone_lock for reading while they use the
+	 * lines, the player or the capture fifos. Remove sets gone and takes it
+	 * for writing once, after that only ref and the wait queue are used.
+	 */
+	struct rw_semaphore gone_lock;
+	bool gone;
+
+	/* Protects values and playing */
+	struct mutex lock;
+	/* Last value written to each line */
+	DECLARE_BITMAP(values, DEMO_GPIO_MAX_LINES);
+	/* The player owns the lines, values is only changed by the player */
+	bool playing;
+
+	/* Waveform player */
+	struct demo_gpio_ring *ring;
+	struct hrtimer play_timer;
+	/* Only used if a line can sleep, the timer then hands over to the worker */
+	struct kthread_worker *play_worker;
+	struct kthread_work play_work;
+	/* Protects play_running and play_stats */
+	spinlock_t play_lock;
+	bool play_running;
+	u32 play_tail;
+	ktime_t play_expires;
+	struct demo_gpio_play_stats play_stats;
+
+	/* Edge capture */
+	struct gpio_descs *inputs;
+	struct demo_gpio_input *input_lines;
+	/* Serializes the readers, the kfifos only allow one consumer */
+	struct mutex capture_lock;
+	wait_queue_head_t capture_wait;
 };
 
+/*
+ * Set the lines in mask to values with one call. If all lines are on the same
+ * chip and in hardware order gpiolib found an array_info for them, then the
+ * whole array is written with a single set_multiple() of the chip.
+ */
+static int demo_gpio_set_values(struct device_tree_demo_driver_data *data,
+				u64 mask, u64 values)
+{
+	DECLARE_BITMAP(mask_bits, DEMO_GPIO_MAX_LINES);
+	DECLARE_BITMAP(value_bits, DEMO_GPIO_MAX_LINES);
+	int ret;
+
+	bitmap_from_arr64(mask_bits, &mask, DEMO_GPIO_MAX_LINES);
+	bitmap_from_arr64(value_bits, &values, DEMO_GPIO_MAX_LINES);
+
+	mutex_lock(&data->lock);
+	if (data->playing) {
+		mutex_unlock(&data->lock);
+		return -EBUSY;
+	}
+	bitmap_andnot(data->values, data->values, mask_bits, DEMO_GPIO_MAX_LINES);
+	bitmap_and(value_bits, value_bits, mask_bits, DEMO_GPIO_MAX_LINES);
+	bitmap_or(data->values, data->values, value_bits, DEMO_GPIO_MAX_LINES);
+	ret = gpiod_set_array_value_cansleep(data->gpios->ndescs, data->gpios->desc,
+					     data->gpios->info, data->values);
+	mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+static int demo_gpio_get_values(struct device_tree_demo_driver_data *data,
+				u64 mask, u64 *values)
+{
+	DECLARE_BITMAP(value_bits, DEMO_GPIO_MAX_LINES);
+	int ret;
+
+	bitmap_zero(value_bits, DEMO_GPIO_MAX_LINES);
+	ret = gpiod_get_array_value_cansleep(data->gpios->ndescs, data->gpios->desc,
+					     data->gpios->info, value_bits);
+	if (ret)
+		return ret;
+
+	bitmap_to_arr64(values, value_bits, DEMO_GPIO_MAX_LINES);
+	*values &= mask;
+
+	return 0;
+}
+
+/*
+ * Apply the commands due at play_expires. Returns true if the player has to
+ * run again at the new play_expires. Only ever runs in one context at a time,
+ * either the hrtimer or the worker.
+ */
+static bool demo_gpio_play(struct device_tree_demo_driver_data *data)
+{
+	struct demo_gpio_ring *ring = data->ring;
+	u32 tail = data->play_tail;
+	DECLARE_BITMAP(mask_bits, DEMO_GPIO_MAX_LINES);
+	DECLARE_BITMAP(value_bits, DEMO_GPIO_MAX_LINES);
+	struct demo_gpio_cmd cmd;
+	unsigned long flags;
+	ktime_t earliest;
+	unsigned int i;
+	s64 jitter;
+	u32 head;
+
+	jitter = ktime_to_ns(ktime_sub(ktime_get(), data->play_expires));
+
+	spin_lock_irqsave(&data->play_lock, flags);
+	if (data->play_running) {
+		data->play_stats.jitter_samples++;
+		data->play_stats.jitter_total_ns += max_t(s64, jitter, 0);
+		data->play_stats.jitter_max_ns = max_t(u64, data->play_stats.jitter_max_ns,
+						       max_t(s64, jitter, 0));
+	}
+	spin_unlock_irqrestore(&data->play_lock, flags);
+
+	/* Commands without delay are applied back to back, but at most one batch */
+	for (i = 0; i < DEMO_GPIO_PLAY_BATCH; i++) {
+		spin_lock_irqsave(&data->play_lock, flags);
+		head = smp_load_acquire(&ring->head);
+		if (!data->play_running || head == tail || head - tail > DEMO_GPIO_RING_ENTRIES) {
+			if (data->play_running && head == tail)
+				data->play_stats.underruns++;
+			else if (data->play_running)
+				dev_warn_ratelimited(data->dev, "invalid ring head %u\n", head);
+			data->play_running = false;
+			spin_unlock_irqrestore(&data->play_lock, flags);
+			return false;
+		}
+		spin_unlock_irqrestore(&data->play_lock, flags);
+
+		cmd = ring->cmds[tail % DEMO_GPIO_RING_ENTRIES];
+
+		bitmap_from_arr64(mask_bits, &cmd.mask, DEMO_GPIO_MAX_LINES);
+		bitmap_from_arr64(value_bits, &cmd.values, DEMO_GPIO_MAX_LINES);
+		bitmap_andnot(data->values, data->values, mask_bits, DEMO_GPIO_MAX_LINES);
+		bitmap_and(value_bits, value_bits, mask_bits, DEMO_GPIO_MAX_LINES);
+		bitmap_or(data->values, data->values, value_bits, DEMO_GPIO_MAX_LINES);
+		if (data->play_worker)
+			gpiod_set_array_value_cansleep(data->gpios->ndescs, data->gpios->desc,
+						       data->gpios->info, data->values);
+		else
+			gpiod_set_array_value(data->gpios->ndescs, data->gpios->desc,
+					      data->gpios->info, data->values);
+
+		data->play_tail = ++tail;
+		smp_store_release(&ring->tail, tail);
+
+		spin_lock_irqsave(&data->play_lock, flags);
+		data->play_stats.commands++;
+		spin_unlock_irqrestore(&data->play_lock, flags);
+
+		if (cmd.delay_ns) {
+			/* Relative to the scheduled time so that errors do not add up */
+			data->play_expires = ktime_add_ns(data->play_expires, cmd.delay_ns);
+			if (ktime_after(data->play_expires, ktime_get()))
+				return true;
+			/* Already due, the schedule fell behind */
+			break;
+		}
+	}
+
+	/* Never restart the timer with an expired time */
+	earliest = ktime_add_ns(ktime_get(), DEMO_GPIO_PLAY_REARM_NS);
+	if (ktime_before(data->play_expires, earliest)) {
+		data->play_expires = earliest;
+		spin_lock_irqsave(&data->play_lock, flags);
+		data->play_stats.overruns++;
+		spin_unlock_irqrestore(&data->play_lock, flags);
+	}
+
+	return true;
+}
+
+static enum hrtimer_restart demo_gpio_play_timer(struct hrtimer *timer)
+{
+	struct device_tree_demo_driver_data *data = container_of(timer,
+			struct device_tree_demo_driver_data, play_timer);
+
+	if (data->play_worker) {
+		kthread_queue_work(data->play_worker, &data->play_work);
+		return HRTIMER_NORESTART;
+	}
+
+	if (!demo_gpio_play(data))
+		return HRTIMER_NORESTART;
+
+	hrtimer_set_expires(timer, data->play_expires);
+
+	return HRTIMER_RESTART;
+}
+
+static void demo_gpio_play_work(struct kthread_work *work)
+{
+	struct device_tree_demo_driver_data *data = container_of(work,
+			struct device_tree_demo_driver_data, play_work);
+	unsigned long flags;
+
+	if (!demo_gpio_play(data))
+		return;
+
+	spin_lock_irqsave(&data->play_lock, flags);
+	if (data->play_running)
+		hrtimer_start(&data->play_timer, data->play_expires, HRTIMER_MODE_ABS_HARD);
+	spin_unlock_irqrestore(&data->play_lock, flags);
+}
+
+static int demo_gpio_play_start(struct device_tree_demo_driver_data *data)
+{
+	unsigned long flags;
+
+	mutex_lock(&data->lock);
+	spin_lock_irqsave(&data->play_lock, flags);
+	if (!data->playing)
+		memset(&data->play_stats, 0, sizeof(data->play_stats));
+	data->playing = true;
+
+	/* Restart a player that ran out of commands */
+	if (!data->play_running) {
+		data->play_running = true;
+		data->play_expires = ktime_get();
+		hrtimer_start(&data->play_timer, data->play_expires, HRTIMER_MODE_ABS_HARD);
+	}
+	spin_unlock_irqrestore(&data->play_lock, flags);
+	mutex_unlock(&data->lock);
+
+	return 0;
+}
+
+static int demo_gpio_play_stop(struct device_tree_demo_driver_data *data)
+{
+	unsigned long flags;
+
+	mutex_lock(&data->lock);
+	spin_lock_irqsave(&data->play_lock, flags);
+	data->play_running = false;
+	spin_unlock_irqrestore(&data->play_lock, flags);
+
+	/* The worker does not rearm the timer once play_running is cleared */
+	hrtimer_cancel(&data->play_timer);
+	if (data->play_worker)
+		kthread_flush_work(&data->play_work);
+	hrtimer_cancel(&data->play_timer);
+
+	data->playing = false;
+	mutex_unlock(&data->lock);
+
+	return 0;
+}
+
+static void demo_gpio_player_release(void *arg)
+{
+	struct device_tree_demo_driver_data *data = arg;
+
+	demo_gpio_play_stop(data);
+	if (data->play_worker)
+		kthread_destroy_worker(data->play_worker);
+	vfree(data->ring);
+}
+
+static int demo_gpio_player_init(struct device_tree_demo_driver_data *data)
+{
+	unsigned int i;
+
+	data->ring = vmalloc_user(sizeof(*data->ring));
+	if (!data->ring)
+		return -ENOMEM;
+
+	data->ring->entries = DEMO_GPIO_RING_ENTRIES;
+	spin_lock_init(&data->play_lock);
+	hrtimer_init(&data->play_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS_HARD);
+	data->play_timer.function = demo_gpio_play_timer;
+
+	/* Lines behind e.g. I2C expanders or gpio-sim can not be set from the hrtimer */
+	for (i = 0; i < data->gpios->ndescs; i++) {
+		if (gpiod_cansleep(data->gpios->desc[i]))
+			break;
+	}
+
+	if (i < data->gpios->ndescs) {
+		data->play_worker = kthread_create_worker(0, "%s-play", dev_name(data->dev));
+		if (IS_ERR(data->play_worker)) {
+			vfree(data->ring);
+			return PTR_ERR(data->play_worker);
+		}
+		sched_set_fifo(data->play_worker->task);
+		kthread_init_work(&data->play_work, demo_gpio_play_work);
+	}
+
+	return devm_add_action_or_reset(data->dev, demo_gpio_player_release, data);
+}
+
+static void demo_gpio_capture_push(struct demo_gpio_input *input, u64 timestamp_ns,
+				   u32 value)
+{
+	struct demo_gpio_edge edge = {
+		.timestamp_ns = timestamp_ns,
+		.line = input->index,
+		.value = value,
+	};
+
+	if (!kfifo_put(&input->fifo, edge))
+		input->overflows++;
+
+	if (wq_has_sleeper(&input->data->capture_wait))
+		wake_up_interruptible(&input->data->capture_wait);
+}
+
+static irqreturn_t demo_gpio_edge_irq(int irq, void *dev_id)
+{
+	struct demo_gpio_input *input = dev_id;
+	u64 timestamp_ns = ktime_get_ns();
+	u32 value = DEMO_GPIO_EDGE_VALUE_UNKNOWN;
+	unsigned long flags;
+
+	input->edges++;
+
+	/* Collect the burst, the filter timer reports it once the line settled */
+	if (input->filter_ns) {
+		/* Runs in a thread if the controller nests its interrupts */
+		spin_lock_irqsave(&input->filter_lock, flags);
+		if (!input->burst_edges)
+			input->burst_start_ns = timestamp_ns;
+		input->burst_edges++;
+		hrtimer_start(&input->filter_timer, ns_to_ktime(input->filter_ns),
+			      HRTIMER_MODE_REL_HARD);
+		spin_unlock_irqrestore(&input->filter_lock, flags);
+
+		return IRQ_HANDLED;
+	}
+
+	if (!input->can_sleep)
+		value = gpiod_get_value(input->desc);
+
+	demo_gpio_capture_push(input, timestamp_ns, value);
+
+	return IRQ_HANDLED;
+}
+
+static enum hrtimer_restart demo_gpio_filter_timer(struct hrtimer *timer)
+{
+	struct demo_gpio_input *input = container_of(timer, struct demo_gpio_input,
+						     filter_timer);
+	u32 value = DEMO_GPIO_EDGE_VALUE_UNKNOWN;
+	unsigned int burst_edges;
+	unsigned long flags;
+	u64 burst_start_ns;
+	bool changed;
+	int level;
+
+	spin_lock_irqsave(&input->filter_lock, flags);
+	burst_edges = input->burst_edges;
+	burst_start_ns = input->burst_start_ns;
+	input->burst_edges = 0;
+	spin_unlock_irqrestore(&input->filter_lock, flags);
+
+	if (!burst_edges)
+		return HRTIMER_NORESTART;
+
+	/*
+	 * If the level can be read compare it with the last reported one,
+	 * else the line changed if there was an odd number of edges.
+	 */
+	if (!input->can_sleep) {
+		level = gpiod_get_value(input->desc);
+		changed = level != input->settled_value;
+		input->settled_value = level;
+		value = level;
+	} else {
+		changed = burst_edges & 1;
+	}
+
+	if (changed) {
+		/* Report the settled level with the time the transition started */
+		demo_gpio_capture_push(input, burst_start_ns, value);
+		burst_edges--;
+	}
+	input->filtered += burst_edges;
+
+	return HRTIMER_NORESTART;
+}
+
+/* One value applies to all lines, else there is one value per line */
+static u32 demo_gpio_input_property(struct device_node *np, const char *name,
+				    unsigned int index)
+{
+	u32 val = 0;
+
+	if (of_property_read_u32_index(np, name, index, &val))
+		of_property_read_u32(np, name, &val);
+
+	return val;
+}
+
+static void demo_gpio_filter_init(struct demo_gpio_input *input, struct device_node *np)
+{
+	u32 debounce_us = demo_gpio_input_property(np, "debounce-us", input->index);
+	u32 glitch_ns = demo_gpio_input_property(np, "glitch-ns", input->index);
+
+	spin_lock_init(&input->filter_lock);
+	hrtimer_init(&input->filter_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_HARD);
+	input->filter_timer.function = demo_gpio_filter_timer;
+	input->settled_value = input->can_sleep ? -1 : gpiod_get_value(input->desc);
+
+	/* Prefer the debounce of the GPIO controller, it does not cost any interrupts */
+	if (debounce_us && !gpiod_set_debounce(input->desc, debounce_us)) {
+		dev_info(input->data->dev, "demo-input %u: hardware debounce %u us\n",
+			 input->index, debounce_us);
+		debounce_us = 0;
+	}
+
+	input->filter_ns = max_t(u64, (u64)debounce_us * NSEC_PER_USEC, glitch_ns);
+	if (input->filter_ns)
+		dev_info(input->data->dev, "demo-input %u: software filter %llu ns\n",
+			 input->index, input->filter_ns);
+}
+
+static bool demo_gpio_capture_pending(struct device_tree_demo_driver_data *data)
+{
+	unsigned int i;
+
+	for (i = 0; i < data->inputs->ndescs; i++) {
+		if (!kfifo_is_empty(&data->input_lines[i].fifo))
+			return true;
+	}
+
+	return false;
+}
+
+static void demo_gpio_capture_release(void *arg)
+{
+	struct device_tree_demo_driver_data *data = arg;
+	unsigned int i;
+
+	for (i = 0; i < data->inputs->ndescs; i++) {
+		hrtimer_cancel(&data->input_lines[i].filter_timer);
+		kfifo_free(&data->input_lines[i].fifo);
+	}
+}
+
+static int demo_gpio_capture_init(struct device_tree_demo_driver_data *data)
+{
+	struct demo_gpio_input *input;
+	unsigned int i;
+	int irq;
+	int ret;
+
+	mutex_init(&data->capture_lock);
+	init_waitqueue_head(&data->capture_wait);
+
+	data->inputs = devm_gpiod_get_array_optional(data->dev, "demo-input", GPIOD_IN);
+	if (IS_ERR(data->inputs))
+		return dev_err_probe(data->dev, PTR_ERR(data->inputs), "invalid demo-input-gpios\n");
+
+	/* Inputs are optional */
+	if (!data->inputs)
+		return 0;
+
+	data->input_lines = devm_kcalloc(data->dev, data->inputs->ndescs,
+					 sizeof(*data->input_lines), GFP_KERNEL);
+	if (!data->input_lines)
+		return -ENOMEM;
+
+	for (i = 0; i < data->inputs->ndescs; i++) {
+		input = &data->input_lines[i];
+		input->data = data;
+		input->desc = data->inputs->desc[i];
+		input->index = i;
+		input->can_sleep = gpiod_cansleep(input->desc);
+		demo_gpio_filter_init(input, data->dev->of_node);
+		ret = kfifo_alloc(&input->fifo, DEMO_GPIO_CAPTURE_FIFO_SIZE, GFP_KERNEL);
+		if (ret) {
+			while (i--)
+				kfifo_free(&data->input_lines[i].fifo);
+			return ret;
+		}
+	}
+
+	ret = devm_add_action_or_reset(data->dev, demo_gpio_capture_release, data);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < data->inputs->ndescs; i++) {
+		input = &data->input_lines[i];
+		irq = gpiod_to_irq(input->desc);
+		if (irq < 0)
+			return dev_err_probe(data->dev, irq, "demo-input %u has no irq\n", i);
+
+		/*
+		 * The timestamp is taken in the hard irq handler. Controllers
+		 * behind a bus (I2C or SPI expanders) only offer nested
+		 * threaded interrupts, there the handler runs in their thread
+		 * and the timestamp is taken after the bus transfer.
+		 */
+		ret = devm_request_any_context_irq(data->dev, irq, demo_gpio_edge_irq,
+						   IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING,
+						   dev_name(data->dev), input);
+		if (ret < 0)
+			return dev_err_probe(data->dev, ret, "can not request irq %d\n", irq);
+		if (ret == IRQC_IS_NESTED)
+			dev_info(data->dev, "demo-input %u: threaded irq, timestamps are late\n", i);
+	}
+
+	return 0;
+}
+
+static void demo_gpio_free(struct kref *ref)
+{
+	kfree(container_of(ref, struct device_tree_demo_driver_data, ref));
+}
+
+static void demo_gpio_put(void *arg)
+{
+	struct device_tree_demo_driver_data *data = arg;
+
+	kref_put(&data->ref, demo_gpio_free);
+}
+
+/* Returns with gone_lock held for reading, unless the device was removed */
+static int demo_gpio_enter(struct device_tree_demo_driver_data *data)
+{
+	down_read(&data->gone_lock);
+	if (data->gone) {
+		up_read(&data->gone_lock);
+		return -ENODEV;
+	}
+
+	return 0;
+}
+
+static void demo_gpio_leave(struct device_tree_demo_driver_data *data)
+{
+	up_read(&data->gone_lock);
+}
+
+static int demo_gpio_open(struct inode *inode, struct file *file)
+{
+	struct device_tree_demo_driver_data *data = container_of(file->private_data,
+			struct device_tree_demo_driver_data, miscdev);
+
+	kref_get(&data->ref);
+
+	return 0;
+}
+
+static int demo_gpio_release(struct inode *inode, struct file *file)
+{
+	struct device_tree_demo_driver_data *data = container_of(file->private_data,
+			struct device_tree_demo_driver_data, miscdev);
+
+	demo_gpio_put(data);
+
+	return 0;
+}
+
+static ssize_t demo_gpio_read(struct file *file, char __user *buf, size_t count,
+			      loff_t *ppos)
+{
+	struct device_tree_demo_driver_data *data = container_of(file->private_data,
+			struct device_tree_demo_driver_data, miscdev);
+	struct demo_gpio_input *input;
+	struct demo_gpio_edge edge;
+	unsigned int copied;
+	size_t total = 0;
+	unsigned int i;
+	u64 latency;
+	int ret = 0;
+
+	if (count < sizeof(struct demo_gpio_edge))
+		return -EINVAL;
+
+	/* Remove wakes the readers and waits until they left */
+	ret = demo_gpio_enter(data);
+	if (ret)
+		return ret;
+
+	if (!data->inputs) {
+		demo_gpio_leave(data);
+		return -EINVAL;
+	}
+
+	for (;;) {
+		mutex_lock(&data->capture_lock);
+		if (demo_gpio_capture_pending(data))
+			break;
+		mutex_unlock(&data->capture_lock);
+
+		if (file->f_flags & O_NONBLOCK)
+			ret = -EAGAIN;
+		else if (READ_ONCE(data->gone))
+			ret = -ENODEV;
+		else
+			ret = wait_event_interruptible(data->capture_wait,
+						       READ_ONCE(data->gone) ||
+						       demo_gpio_capture_pending(data));
+		if (ret) {
+			demo_gpio_leave(data);
+			return ret;
+		}
+	}
+
+	/* Drain the lines one after the other, each record carries its line */
+	for (i = 0; i < data->inputs->ndescs; i++) {
+		input = &data->input_lines[i];
+		if (!kfifo_peek(&input->fifo, &edge))
+			continue;
+
+		/* The oldest edge waited the longest, use it for the latency */
+		latency = ktime_get_ns() - edge.timestamp_ns;
+		input->latency_samples++;
+		input->latency_total_ns += latency;
+		input->latency_max_ns = max(input->latency_max_ns, latency);
+
+		ret = kfifo_to_user(&input->fifo, buf + total, count - total, &copied);
+		if (ret)
+			break;
+		total += copied;
+		if (count - total < sizeof(struct demo_gpio_edge))
+			break;
+	}
+	mutex_unlock(&data->capture_lock);
+	demo_gpio_leave(data);
+
+	return total ? total : ret;
+}
+
+static __poll_t demo_gpio_poll(struct file *file, poll_table *wait)
+{
+	struct device_tree_demo_driver_data *data = container_of(file->private_data,
+			struct device_tree_demo_driver_data, miscdev);
+	__poll_t mask = 0;
+
+	poll_wait(file, &data->capture_wait, wait);
+
+	if (demo_gpio_enter(data))
+		return EPOLLHUP | EPOLLERR;
+
+	if (data->inputs && demo_gpio_capture_pending(data))
+		mask = EPOLLIN | EPOLLRDNORM;
+	demo_gpio_leave(data);
+
+	return mask;
+}
+
 static ssize_t demo_gpio_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
 {
 	struct device_tree_demo_driver_data *data = dev_get_drvdata(dev);
 	int val;
+	int ret;
 
 	if (sscanf(buf, "%d", &val) != 1)
 	    return -EINVAL;
 
-	gpio_set_value(data->gpio, val);
+	// All lines follow the value written to sysfs
+	ret = demo_gpio_set_values(data, U64_MAX, val ? U64_MAX : 0);
+	if (ret)
+	    return ret;
 
 	return count;
 }
 
 static DEVICE_ATTR(demo_gpio, S_IWUSR, NULL, demo_gpio_store);
 
+static long demo_gpio_do_ioctl(struct device_tree_demo_driver_data *data,
+			       unsigned int cmd, unsigned long arg)
+{
+	void __user *argp = (void __user *)arg;
+	struct demo_gpio_capture_stats capture_stats;
+	struct demo_gpio_play_stats stats;
+	struct demo_gpio_input *input;
+	struct demo_gpio_values vals;
+	unsigned long flags;
+	u32 count;
+	int ret;
+
+	switch (cmd) {
+	case DEMO_GPIO_GET_LINE_COUNT:
+		count = data->gpios->ndescs;
+		if (copy_to_user(argp, &count, sizeof(count)))
+			return -EFAULT;
+		return 0;
+	case DEMO_GPIO_SET_VALUES:
+		if (copy_from_user(&vals, argp, sizeof(vals)))
+			return -EFAULT;
+		return demo_gpio_set_values(data, vals.mask, vals.values);
+	case DEMO_GPIO_GET_VALUES:
+		if (copy_from_user(&vals, argp, sizeof(vals)))
+			return -EFAULT;
+		ret = demo_gpio_get_values(data, vals.mask, &vals.values);
+		if (ret)
+			return ret;
+		if (copy_to_user(argp, &vals, sizeof(vals)))
+			return -EFAULT;
+		return 0;
+	case DEMO_GPIO_PLAY_START:
+		return demo_gpio_play_start(data);
+	case DEMO_GPIO_PLAY_STOP:
+		return demo_gpio_play_stop(data);
+	case DEMO_GPIO_GET_PLAY_STATS:
+		spin_lock_irqsave(&data->play_lock, flags);
+		stats = data->play_stats;
+		spin_unlock_irqrestore(&data->play_lock, flags);
+		if (copy_to_user(argp, &stats, sizeof(stats)))
+			return -EFAULT;
+		return 0;
+	case DEMO_GPIO_GET_INPUT_COUNT:
+		count = data->inputs ? data->inputs->ndescs : 0;
+		if (copy_to_user(argp, &count, sizeof(count)))
+			return -EFAULT;
+		return 0;
+	case DEMO_GPIO_GET_CAPTURE_STATS:
+		if (copy_from_user(&capture_stats, argp, sizeof(capture_stats)))
+			return -EFAULT;
+		if (!data->inputs || capture_stats.line >= data->inputs->ndescs)
+			return -EINVAL;
+		input = &data->input_lines[capture_stats.line];
+		mutex_lock(&data->capture_lock);
+		capture_stats.edges = READ_ONCE(input->edges);
+		capture_stats.overflows = READ_ONCE(input->overflows);
+		capture_stats.filtered = READ_ONCE(input->filtered);
+		capture_stats.latency_samples = input->latency_samples;
+		capture_stats.latency_max_ns = input->latency_max_ns;
+		capture_stats.latency_total_ns = input->latency_total_ns;
+		mutex_unlock(&data->capture_lock);
+		if (copy_to_user(argp, &capture_stats, sizeof(capture_stats)))
+			return -EFAULT;
+		return 0;
+	default:
+		return -ENOTTY;
+	}
+}
+
+static long demo_gpio_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	struct device_tree_demo_driver_data *data = container_of(file->private_data,
+			struct device_tree_demo_driver_data, miscdev);
+	long ret;
+
+	ret = demo_gpio_enter(data);
+	if (ret)
+		return ret;
+
+	ret = demo_gpio_do_ioctl(data, cmd, arg);
+	demo_gpio_leave(data);
+
+	return ret;
+}
+
+static int demo_gpio_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct device_tree_demo_driver_data *data = container_of(file->private_data,
+			struct device_tree_demo_driver_data, miscdev);
+	int ret;
+
+	ret = demo_gpio_enter(data);
+	if (ret)
+		return ret;
+
+	/* The mapping holds its own reference to the pages of the ring */
+	ret = remap_vmalloc_range(vma, data->ring, vma->vm_pgoff);
+	demo_gpio_leave(data);
+
+	return ret;
+}
+
+static const struct file_operations demo_gpio_fops = {
+	.owner = THIS_MODULE,
+	.open = demo_gpio_open,
+	.release = demo_gpio_release,
+	.read = demo_gpio_read,
+	.poll = demo_gpio_poll,
+	.unlocked_ioctl = demo_gpio_ioctl,
+	.mmap = demo_gpio_mmap,
+	.compat_ioctl = compat_ptr_ioctl,
+	.llseek = no_llseek,
+};
+
 static int device_tree_demo_driver_probe(struct platform_device *pdev)
 {
     struct device_node *np = pdev->dev.of_node;
     struct device_tree_demo_driver_data *data;
     const char *str;
-    int gpio;
+    int ret;
 
     if (!np)
     {
@@ -48,36 +876,84 @@ static int device_tree_demo_driver_probe(struct platform_device *pdev)
 
     dev_info(&pdev->dev, "demo-string: %s\n", str);
 
-    // Get a gpio from the device tree
-    gpio = of_get_named_gpio(np, "demo-gpio", 0);
-    if (!gpio_is_valid(gpio))
-	return -EINVAL;
+    // Create a private data structure to hold the gpios, open files keep it alive after remove
+    data = kzalloc(sizeof(struct device_tree_demo_driver_data), GFP_KERNEL);
+    if (!data)
+	return -ENOMEM;
 
-    if (gpio_request(gpio, "demo-gpio"))
-	return -EINVAL;
+    kref_init(&data->ref);
+    init_rwsem(&data->gone_lock);
+
+    // Registered first, the reference of the device is dropped after all other devm actions ran
+    ret = devm_add_action_or_reset(&pdev->dev, demo_gpio_put, data);
+    if (ret)
+	return ret;
+
+    data->dev = &pdev->dev;
+    mutex_init(&data->lock);
 
-    // Set the gpio to output and set it to 1
-    gpio_direction_output(gpio, 1);
+    // Get all gpios from demo-gpios (or the legacy demo-gpio), set them to output and 1
+    data->gpios = devm_gpiod_get_array(&pdev->dev, "demo", GPIOD_OUT_HIGH);
+    if (IS_ERR(data->gpios))
+	return dev_err_probe(&pdev->dev, PTR_ERR(data->gpios), "no demo-gpios\n");
 
-    // Create a sysfs entry to set the gpio
-    if (device_create_file(&pdev->dev, &dev_attr_demo_gpio))
+    if (data->gpios->ndescs > DEMO_GPIO_MAX_LINES)
+    {
+	dev_err(&pdev->dev, "at most %d demo-gpios are supported\n", DEMO_GPIO_MAX_LINES);
 	return -EINVAL;
+    }
 
-    // Create a private data structure to hold the gpio
-    data = devm_kzalloc(&pdev->dev, sizeof(struct device_tree_demo_driver_data), GFP_KERNEL);
-    if (!data)
-	return -ENOMEM;
+    bitmap_fill(data->values, data->gpios->ndescs);
 
-    data->gpio = gpio;
+    if (data->gpios->info)
+	dev_info(&pdev->dev, "%u gpios on one chip, using the fast path\n", data->gpios->ndescs);
+
+    // The waveform player plays commands from a ring mapped to userspace
+    ret = demo_gpio_player_init(data);
+    if (ret)
+	return ret;
+
+    // Optional input lines whose edges are timestamped and can be read from the character device
+    ret = demo_gpio_capture_init(data);
+    if (ret)
+	return ret;
 
     // Set the private data structure to the platform device
     dev_set_drvdata(&pdev->dev, data);
 
+    // Create a sysfs entry to set the gpios
+    ret = device_create_file(&pdev->dev, &dev_attr_demo_gpio);
+    if (ret)
+	return ret;
+
+    // Create a character device to set all gpios with one ioctl
+    data->miscdev.minor = MISC_DYNAMIC_MINOR;
+    data->miscdev.name = dev_name(&pdev->dev);
+    data->miscdev.fops = &demo_gpio_fops;
+    data->miscdev.parent = &pdev->dev;
+    ret = misc_register(&data->miscdev);
+    if (ret)
+    {
+	device_remove_file(&pdev->dev, &dev_attr_demo_gpio);
+	return ret;
+    }
+
     return 0;
 }
 
 static int device_tree_demo_driver_remove(struct platform_device *pdev)
 {
+    struct device_tree_demo_driver_data *data = dev_get_drvdata(&pdev->dev);
+
+    misc_deregister(&data->miscdev);
+    device_remove_file(&pdev->dev, &dev_attr_demo_gpio);
+
+    // Files that are still open must not touch the lines, the player or the fifos released by devm
+    WRITE_ONCE(data->gone, true);
+    wake_up_interruptible_all(&data->capture_wait);
+    down_write(&data->gone_lock);
+    up_write(&data->gone_lock);
+
     return 0;
 }
 
@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: GPL-2.0-only WITH Linux-syscall-note */
+/*
+ * How to use device trees, demo driver userspace interface
+ *
+ * Copyright (C) Stefan Eichenberger <stefan@embear.ch>
+ */
+#ifndef _DEVICE_TREE_DEMO_H
+#define _DEVICE_TREE_DEMO_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/* Bit n of mask and values corresponds to the n-th entry of demo-gpios */
+#define DEMO_GPIO_MAX_LINES	64
+
+struct demo_gpio_values {
+	__u64 mask;	/* lines to set or read */
+	__u64 values;	/* line values, bits outside of mask are ignored */
+};
+
+#define DEMO_GPIO_IOC_MAGIC	'D'
+
+/* Number of lines found in demo-gpios */
+#define DEMO_GPIO_GET_LINE_COUNT	_IOR(DEMO_GPIO_IOC_MAGIC, 0, __u32)
+/* Set all lines in mask at once, the other lines keep their value */
+#define DEMO_GPIO_SET_VALUES		_IOW(DEMO_GPIO_IOC_MAGIC, 1, struct demo_gpio_values)
+/* Read the lines in mask, values is filled in by the driver */
+#define DEMO_GPIO_GET_VALUES		_IOWR(DEMO_GPIO_IOC_MAGIC, 2, struct demo_gpio_values)
+
+/*
+ * Waveform player: userspace mmaps a struct demo_gpio_ring from the character
+ * device, appends commands at head and then calls DEMO_GPIO_PLAY_START. The
+ * driver applies one command after the other from an hrtimer and advances
+ * tail. Each command sets the lines in mask to values and then waits delay_ns
+ * before the next command is applied.
+ */
+#define DEMO_GPIO_RING_ENTRIES	4096
+
+struct demo_gpio_cmd {
+	__u64 mask;
+	__u64 values;
+	__u64 delay_ns;
+};
+
+struct demo_gpio_ring {
+	__u32 head;	/* written by userspace, free running */
+	__u32 tail;	/* written by the driver, free running */
+	__u32 entries;	/* DEMO_GPIO_RING_ENTRIES */
+	__u32 reserved;
+	struct demo_gpio_cmd cmds[DEMO_GPIO_RING_ENTRIES];
+};
+
+struct demo_gpio_play_stats {
+	__u64 commands;		/* commands applied */
+	__u64 underruns;	/* the ring ran empty while playing */
+	__u64 jitter_samples;	/* timed commands the jitter was measured for */
+	__u64 jitter_max_ns;	/* worst delay between scheduled and actual time */
+	__u64 jitter_total_ns;	/* sum, divide by jitter_samples for the mean */
+	__u64 overruns;		/* a batch was used up or the schedule fell behind */
+};
+
+/* Start playing, a no-op while the player still has commands to play */
+#define DEMO_GPIO_PLAY_START		_IO(DEMO_GPIO_IOC_MAGIC, 3)
+/* Stop playing, commands not yet played stay in the ring */
+#define DEMO_GPIO_PLAY_STOP		_IO(DEMO_GPIO_IOC_MAGIC, 4)
+#define DEMO_GPIO_GET_PLAY_STATS	_IOR(DEMO_GPIO_IOC_MAGIC, 5, struct demo_gpio_play_stats)
+
+/*
+ * Edge capture: every edge of the lines in demo-input-gpios is timestamped in
+ * the interrupt handler. read() on the character device returns as many
+ * struct demo_gpio_edge records as fit into the buffer.
+ */
+#define DEMO_GPIO_EDGE_VALUE_UNKNOWN	0xffffffff
+
+struct demo_gpio_edge {
+	__u64 timestamp_ns;	/* CLOCK_MONOTONIC */
+	__u32 line;		/* index in demo-input-gpios */
+	__u32 value;		/* level after the edge, unknown if the line can sleep */
+};
+
+struct demo_gpio_capture_stats {
+	__u32 line;		/* set by userspace */
+	__u32 reserved;
+	__u64 edges;		/* edges captured */
+	__u64 overflows;	/* edges dropped because the fifo was full */
+	__u64 filtered;		/* edges swallowed by the debounce/glitch filter */
+	__u64 latency_samples;	/* reads the latency was measured for */
+	__u64 latency_max_ns;	/* worst time from edge to read() */
+	__u64 latency_total_ns;	/* sum, divide by latency_samples for the mean */
+};
+
+/* Number of lines found in demo-input-gpios */
+#define DEMO_GPIO_GET_INPUT_COUNT	_IOR(DEMO_GPIO_IOC_MAGIC, 6, __u32)
+#define DEMO_GPIO_GET_CAPTURE_STATS	_IOWR(DEMO_GPIO_IOC_MAGIC, 7, struct demo_gpio_capture_stats)
+
+#endif /* _DEVICE_TREE_DEMO_H */
@@ -4,31 +4,217 @@
  *
  * Copyright (C) Stefan Eichenberger <stefan@embear.ch>
  */
+#include <linux/fs.h>
+#include <linux/kfifo.h>
+#include <linux/kref.h>
 #include <linux/leds.h>
+#include <linux/list.h>
+#include <linux/miscdevice.h>
+#include <linux/mutex.h>
 #include <linux/of.h>
 #include <linux/of_platform.h>
 #include <linux/module.h>
 #include <linux/platform_device.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/timer.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+
+#include "led-control.h"
+
+/* Number of events a reader can lag behind before the oldest get dropped */
+#define LED_CONTROL_EVENT_FIFO_SIZE 16
+
+/* Default fade step period, 50 steps per second */
+#define LED_CONTROL_FADE_STEP_MS 20
+
+struct device_state_led_blink_entry;
 
 struct led_control_data {
 	struct device *dev;
 	struct led_classdev *led_cdev;
 	const char *state;
+	u32 state_index;
+
+	/* Protects state, readers and gone */
+	struct mutex lock;
+	struct list_head readers;
+	wait_queue_head_t wait;
+	struct miscdevice miscdev;
+	/* Held by the device and by every open reader, which may outlive remove */
+	struct kref ref;
+	/* Set on remove, readers get -ENODEV once they drained their fifo */
+	bool gone;
+
+	/* Fade engine, a fade_ms of 0 disables fading */
+	unsigned int fade_ms;
+	unsigned int fade_step_ms;
+
+	/* Protects the fade state shared between timer and work */
+	spinlock_t fade_lock;
+	struct timer_list fade_timer;
+	struct work_struct brightness_work;
+	const struct device_state_led_blink_entry *fade_entry;
+	unsigned int fade_from;
+	unsigned int fade_to;
+	unsigned int fade_step;
+	unsigned int fade_steps;
+	bool fade_done;
+	/* Latest brightness not yet written to the LED, -1 if none */
+	int pending_brightness;
+	unsigned long steps_applied;
+	unsigned long steps_dropped;
+};
+
+/* Every open file gets its own fifo so that several daemons can mirror the state */
+struct led_control_reader {
+	struct list_head list;
+	struct led_control_data *pdata;
+	DECLARE_KFIFO(events, struct led_control_event, LED_CONTROL_EVENT_FIFO_SIZE);
 };
 
 struct device_state_led_blink_entry {
 	const char *device_state;
 	unsigned long time_on;
 	unsigned long time_off;
+	/* Brightness a fade ends at, blinking starts afterwards if time_off is set */
+	unsigned int brightness;
 };
 
 #define FIRST_STATE "booting"
+/* The order has to match enum led_control_state */
 static struct device_state_led_blink_entry device_state_led_blink_table[] = {
-	{FIRST_STATE, 500, 100},
-	{"running", 500, 0},
-	{"shutdown", 100, 500}
+	[LED_CONTROL_STATE_BOOTING] = {FIRST_STATE, 500, 100, LED_FULL},
+	[LED_CONTROL_STATE_RUNNING] = {"running", 500, 0, LED_FULL},
+	[LED_CONTROL_STATE_SHUTDOWN] = {"shutdown", 100, 500, LED_OFF}
 };
 
+static void led_control_fade_timer(struct timer_list *t)
+{
+	struct led_control_data *pdata = from_timer(pdata, t, fade_timer);
+	unsigned long flags;
+	int delta;
+
+	spin_lock_irqsave(&pdata->fade_lock, flags);
+	pdata->fade_step++;
+	delta = (int)pdata->fade_to - (int)pdata->fade_from;
+
+	/* The work did not catch up with the previous step, it gets replaced */
+	if (pdata->pending_brightness >= 0)
+		pdata->steps_dropped++;
+	pdata->pending_brightness = pdata->fade_from +
+		delta * (int)pdata->fade_step / (int)pdata->fade_steps;
+
+	if (pdata->fade_step < pdata->fade_steps)
+		mod_timer(&pdata->fade_timer,
+			  jiffies + msecs_to_jiffies(pdata->fade_step_ms));
+	else
+		pdata->fade_done = true;
+	spin_unlock_irqrestore(&pdata->fade_lock, flags);
+
+	schedule_work(&pdata->brightness_work);
+}
+
+/*
+ * Writes the latest pending brightness. A work that is already queued is not
+ * queued again, therefore a slow bus only ever sees the newest value.
+ */
+static void led_control_brightness_work(struct work_struct *work)
+{
+	struct led_control_data *pdata = container_of(work,
+			struct led_control_data, brightness_work);
+	struct led_classdev *led_cdev = pdata->led_cdev;
+	const struct device_state_led_blink_entry *blink_entry = NULL;
+	unsigned long flags;
+	int brightness;
+
+	spin_lock_irqsave(&pdata->fade_lock, flags);
+	brightness = pdata->pending_brightness;
+	pdata->pending_brightness = -1;
+	if (pdata->fade_done) {
+		pdata->fade_done = false;
+		if (pdata->fade_entry->time_off)
+			blink_entry = pdata->fade_entry;
+	}
+	spin_unlock_irqrestore(&pdata->fade_lock, flags);
+
+	if (brightness >= 0) {
+		if (led_cdev->brightness_set_blocking)
+			led_set_brightness_sync(led_cdev, brightness);
+		else
+			led_set_brightness_nosleep(led_cdev, brightness);
+
+		spin_lock_irqsave(&pdata->fade_lock, flags);
+		pdata->steps_applied++;
+		spin_unlock_irqrestore(&pdata->fade_lock, flags);
+	}
+
+	if (blink_entry) {
+		unsigned long time_on = blink_entry->time_on;
+		unsigned long time_off = blink_entry->time_off;
+
+		led_blink_set(led_cdev, &time_on, &time_off);
+	}
+}
+
+static void led_control_stop_fade(struct led_control_data *pdata)
+{
+	del_timer_sync(&pdata->fade_timer);
+	cancel_work_sync(&pdata->brightness_work);
+}
+
+/* Must be called with pdata->lock held */
+static void led_control_start_fade(struct led_control_data *pdata,
+		const struct device_state_led_blink_entry *entry)
+{
+	struct led_classdev *led_cdev = pdata->led_cdev;
+	unsigned long flags;
+
+	led_control_stop_fade(pdata);
+
+	/* Fading out of a blinking state starts with the LED off */
+	if (pdata->state_index < ARRAY_SIZE(device_state_led_blink_table) &&
+	    device_state_led_blink_table[pdata->state_index].time_off) {
+		led_set_brightness(led_cdev, LED_OFF);
+		flush_work(&led_cdev->set_brightness_work);
+	}
+
+	spin_lock_irqsave(&pdata->fade_lock, flags);
+	pdata->fade_entry = entry;
+	pdata->fade_from = led_cdev->brightness;
+	pdata->fade_to = min(entry->brightness, led_cdev->max_brightness);
+	pdata->fade_step = 0;
+	pdata->fade_steps = max(DIV_ROUND_UP(pdata->fade_ms, pdata->fade_step_ms), 1U);
+	pdata->fade_done = false;
+	pdata->pending_brightness = -1;
+	mod_timer(&pdata->fade_timer, jiffies + msecs_to_jiffies(pdata->fade_step_ms));
+	spin_unlock_irqrestore(&pdata->fade_lock, flags);
+}
+
+/* Must be called with pdata->lock held */
+static void led_control_push_event(struct led_control_data *pdata,
+		u32 old_state, u32 new_state)
+{
+	struct led_control_event event = {
+		.timestamp_ns = ktime_get_ns(),
+		.old_state = old_state,
+		.new_state = new_state,
+	};
+	struct led_control_reader *reader;
+
+	list_for_each_entry(reader, &pdata->readers, list) {
+		/* A slow reader loses the oldest events, never the latest state */
+		if (kfifo_is_full(&reader->events))
+			kfifo_skip(&reader->events);
+		kfifo_put(&reader->events, event);
+	}
+
+	wake_up_interruptible(&pdata->wait);
+}
+
 static ssize_t set_device_state(struct led_control_data *pdata,
 		const char *state, size_t count)
 {
@@ -42,9 +228,23 @@ static ssize_t set_device_state(struct led_control_data *pdata,
 			&device_state_led_blink_table[i];
 		pr_info("cmp %s with %s\n", state, entry->device_state);
 		if (!strncmp(entry->device_state, state, count-1)) {
-			led_blink_set(pdata->led_cdev,
-					&entry->time_on, &entry->time_off);
+			u32 old_state;
+
+			mutex_lock(&pdata->lock);
+			if (pdata->fade_ms) {
+				led_control_start_fade(pdata, entry);
+			} else {
+				led_control_stop_fade(pdata);
+				led_blink_set(pdata->led_cdev,
+						&entry->time_on, &entry->time_off);
+			}
+			old_state = pdata->state_index;
 			pdata->state = entry->device_state;
+			pdata->state_index = i;
+			led_control_push_event(pdata, old_state, i);
+			mutex_unlock(&pdata->lock);
+
+			sysfs_notify(&pdata->dev->kobj, NULL, "device_state");
 			break;
 		}
 	}
@@ -76,6 +276,208 @@ static ssize_t device_state_store(struct device *dev, struct device_attribute *a
 
 DEVICE_ATTR_RW(device_state);
 
+static ssize_t fade_ms_show(struct device *dev, struct device_attribute *attr,
+		char *buf)
+{
+	struct led_control_data *pdata = dev_get_drvdata(dev);
+
+	return sysfs_emit(buf, "%u\n", pdata->fade_ms);
+}
+
+static ssize_t fade_ms_store(struct device *dev, struct device_attribute *attr,
+		 const char *buf, size_t count)
+{
+	struct led_control_data *pdata = dev_get_drvdata(dev);
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint(buf, 0, &val);
+	if (ret)
+		return ret;
+
+	mutex_lock(&pdata->lock);
+	pdata->fade_ms = val;
+	mutex_unlock(&pdata->lock);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(fade_ms);
+
+static ssize_t fade_step_ms_show(struct device *dev, struct device_attribute *attr,
+		char *buf)
+{
+	struct led_control_data *pdata = dev_get_drvdata(dev);
+
+	return sysfs_emit(buf, "%u\n", pdata->fade_step_ms);
+}
+
+static ssize_t fade_step_ms_store(struct device *dev, struct device_attribute *attr,
+		 const char *buf, size_t count)
+{
+	struct led_control_data *pdata = dev_get_drvdata(dev);
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint(buf, 0, &val);
+	if (ret)
+		return ret;
+
+	if (!val)
+		return -EINVAL;
+
+	/* Only takes effect on the next fade, a running one keeps its rate */
+	mutex_lock(&pdata->lock);
+	pdata->fade_step_ms = val;
+	mutex_unlock(&pdata->lock);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(fade_step_ms);
+
+static ssize_t fade_stats_show(struct device *dev, struct device_attribute *attr,
+		char *buf)
+{
+	struct led_control_data *pdata = dev_get_drvdata(dev);
+	unsigned long applied, dropped;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pdata->fade_lock, flags);
+	applied = pdata->steps_applied;
+	dropped = pdata->steps_dropped;
+	spin_unlock_irqrestore(&pdata->fade_lock, flags);
+
+	return sysfs_emit(buf, "applied: %lu\ndropped: %lu\n", applied, dropped);
+}
+
+static DEVICE_ATTR_RO(fade_stats);
+
+static struct attribute *led_control_attrs[] = {
+	&dev_attr_device_state.attr,
+	&dev_attr_fade_ms.attr,
+	&dev_attr_fade_step_ms.attr,
+	&dev_attr_fade_stats.attr,
+	NULL,
+};
+
+static const struct attribute_group led_control_group = {
+	.attrs = led_control_attrs,
+};
+
+static void led_control_free(struct kref *ref)
+{
+	kfree(container_of(ref, struct led_control_data, ref));
+}
+
+static int led_control_open(struct inode *inode, struct file *file)
+{
+	struct led_control_data *pdata = container_of(file->private_data,
+			struct led_control_data, miscdev);
+	struct led_control_reader *reader;
+	struct led_control_event event;
+
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
+	INIT_KFIFO(reader->events);
+	reader->pdata = pdata;
+
+	/* The first record tells the reader the current state */
+	mutex_lock(&pdata->lock);
+	event.timestamp_ns = ktime_get_ns();
+	event.old_state = LED_CONTROL_STATE_NONE;
+	event.new_state = pdata->state_index;
+	kfifo_put(&reader->events, event);
+	list_add_tail(&reader->list, &pdata->readers);
+	kref_get(&pdata->ref);
+	mutex_unlock(&pdata->lock);
+
+	file->private_data = reader;
+
+	return stream_open(inode, file);
+}
+
+static int led_control_release(struct inode *inode, struct file *file)
+{
+	struct led_control_reader *reader = file->private_data;
+	struct led_control_data *pdata = reader->pdata;
+
+	mutex_lock(&pdata->lock);
+	list_del(&reader->list);
+	mutex_unlock(&pdata->lock);
+
+	kfree(reader);
+	kref_put(&pdata->ref, led_control_free);
+
+	return 0;
+}
+
+static ssize_t led_control_read(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	struct led_control_reader *reader = file->private_data;
+	struct led_control_data *pdata = reader->pdata;
+	unsigned int copied;
+	int ret;
+
+	if (count < sizeof(struct led_control_event))
+		return -EINVAL;
+
+	for (;;) {
+		mutex_lock(&pdata->lock);
+		if (!kfifo_is_empty(&reader->events))
+			break;
+		ret = pdata->gone ? -ENODEV : 0;
+		mutex_unlock(&pdata->lock);
+		if (ret)
+			return ret;
+
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+
+		ret = wait_event_interruptible(pdata->wait,
+				!kfifo_is_empty(&reader->events) ||
+				READ_ONCE(pdata->gone));
+		if (ret)
+			return ret;
+	}
+
+	/* Only whole records are copied, as many as fit into buf */
+	ret = kfifo_to_user(&reader->events, buf, count, &copied);
+	mutex_unlock(&pdata->lock);
+
+	return ret ? ret : copied;
+}
+
+static __poll_t led_control_poll(struct file *file, poll_table *wait)
+{
+	struct led_control_reader *reader = file->private_data;
+	struct led_control_data *pdata = reader->pdata;
+	__poll_t mask = 0;
+
+	poll_wait(file, &pdata->wait, wait);
+
+	mutex_lock(&pdata->lock);
+	if (!kfifo_is_empty(&reader->events))
+		mask |= EPOLLIN | EPOLLRDNORM;
+	else if (pdata->gone)
+		mask |= EPOLLHUP | EPOLLERR;
+	mutex_unlock(&pdata->lock);
+
+	return mask;
+}
+
+static const struct file_operations led_control_fops = {
+	.owner		= THIS_MODULE,
+	.open		= led_control_open,
+	.release	= led_control_release,
+	.read		= led_control_read,
+	.poll		= led_control_poll,
+	.llseek		= no_llseek,
+};
+
 static int match_led(struct device *dev, void *data)
 {
 	return dev->of_node->phandle == ((struct device_node*)data)->phandle;
@@ -91,12 +493,23 @@ static int led_control_probe(struct platform_device *pdev)
 	struct device *led_dev;
 	int err = 0;
 
-	data = devm_kzalloc(&pdev->dev, sizeof(*data), GFP_KERNEL);
+	/* Not devm, an open reader keeps it after remove */
+	data = kzalloc(sizeof(*data), GFP_KERNEL);
 	if (!data)
 		return -ENOMEM;
 
 	data->dev = &pdev->dev;
 	np = data->dev->of_node;
+	kref_init(&data->ref);
+	mutex_init(&data->lock);
+	INIT_LIST_HEAD(&data->readers);
+	init_waitqueue_head(&data->wait);
+	data->state_index = LED_CONTROL_STATE_NONE;
+	spin_lock_init(&data->fade_lock);
+	timer_setup(&data->fade_timer, led_control_fade_timer, 0);
+	INIT_WORK(&data->brightness_work, led_control_brightness_work);
+	data->fade_step_ms = LED_CONTROL_FADE_STEP_MS;
+	data->pending_brightness = -1;
 	dev_set_drvdata(&pdev->dev, data);
 
 	/* Now we need to find the led class device from the phandle provided
@@ -106,6 +519,7 @@ static int led_control_probe(struct platform_device *pdev)
 	led_node = of_parse_phandle(np, "led", 0);
 	if (!led_node) {
 		pr_err("No led node found\n");
+		kfree(data);
 		return -EINVAL;
 	}
 
@@ -114,6 +528,7 @@ static int led_control_probe(struct platform_device *pdev)
 	if (!leds_node) {
 		of_node_put(led_node);
 		pr_err("Can not get parent node\n");
+		kfree(data);
 		return -EINVAL;
 	}
 
@@ -144,8 +559,8 @@ static int led_control_probe(struct platform_device *pdev)
 		goto error;
 	}
 
-	/* Create the sysfs entry */
-	err = device_create_file(&pdev->dev, &dev_attr_device_state);
+	/* Create the sysfs entries */
+	err = device_add_group(&pdev->dev, &led_control_group);
 	if (err) {
 		pr_err("Could not create sysfs file: %d\n", err);
 		goto error;
@@ -153,19 +568,45 @@ static int led_control_probe(struct platform_device *pdev)
 
 	set_device_state(data, FIRST_STATE, sizeof(FIRST_STATE));
 
+	/* Create the character device delivering the state changes */
+	data->miscdev.minor = MISC_DYNAMIC_MINOR;
+	data->miscdev.name = dev_name(&pdev->dev);
+	data->miscdev.fops = &led_control_fops;
+	data->miscdev.parent = &pdev->dev;
+	err = misc_register(&data->miscdev);
+	if (err) {
+		pr_err("Could not register misc device: %d\n", err);
+		led_control_stop_fade(data);
+		device_remove_group(&pdev->dev, &led_control_group);
+		goto error;
+	}
+
 	return 0;
 
 error:
 	/* Return all nodes on error */
 	of_node_put(led_node);
 	of_node_put(leds_node);
+	kfree(data);
 
 	return err;
 }
 
 static int led_control_remove(struct platform_device *pdev)
 {
-	device_remove_file(&pdev->dev, &dev_attr_device_state);
+	struct led_control_data *data = dev_get_drvdata(&pdev->dev);
+
+	misc_deregister(&data->miscdev);
+	device_remove_group(&pdev->dev, &led_control_group);
+	led_control_stop_fade(data);
+
+	/* Readers still open only see their remaining events, then -ENODEV */
+	mutex_lock(&data->lock);
+	data->gone = true;
+	mutex_unlock(&data->lock);
+	wake_up_interruptible(&data->wait);
+
+	kref_put(&data->ref, led_control_free);
 
 	return 0;
 }
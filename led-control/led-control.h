@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: GPL-2.0-only WITH Linux-syscall-note */
+/*
+ * LEDs control driver, userspace interface
+ *
+ * Copyright (C) Stefan Eichenberger <stefan@embear.ch>
+ */
+#ifndef _LED_CONTROL_H
+#define _LED_CONTROL_H
+
+#include <linux/types.h>
+
+/* Index of the device states, same order as the device_state strings */
+enum led_control_state {
+	LED_CONTROL_STATE_BOOTING = 0,
+	LED_CONTROL_STATE_RUNNING = 1,
+	LED_CONTROL_STATE_SHUTDOWN = 2,
+
+	/* Used as old_state of the first event a reader gets */
+	LED_CONTROL_STATE_NONE = 0xffffffff,
+};
+
+/* One record returned by read() on /dev/<led-control device> */
+struct led_control_event {
+	__u64 timestamp_ns;	/* CLOCK_MONOTONIC */
+	__u32 old_state;
+	__u32 new_state;
+};
+
+#endif /* _LED_CONTROL_H */
@@ -23,7 +23,7 @@ if [ -f "$KERNEL_DIR/drivers/gpu/drm/panel/panel-mipi-dsi.c" ]; then
 	echo "Overwriting panel-mipi-dsi.c"
     fi
 fi
-cp panel-mipi-dsi.c "$KERNEL_DIR/drivers/gpu/drm/panel/"
+cp panel-mipi-dsi.c panel-mipi-dsi-trace.h "$KERNEL_DIR/drivers/gpu/drm/panel/"
 
 # Add it to the Makefile
 MAKEFILE="$KERNEL_DIR/drivers/gpu/drm/panel/Makefile"
@@ -33,6 +33,10 @@ else
     echo "Adding panel-mipi-dsi.o to $MAKEFILE"
     echo "obj-\$(CONFIG_DRM_PANEL_MIPI_DSI) += panel-mipi-dsi.o" >> "$MAKEFILE"
 fi
+# The tracepoints are defined in panel-mipi-dsi-trace.h next to the driver
+if ! grep -q "CFLAGS_panel-mipi-dsi.o" "$MAKEFILE"; then
+    echo "CFLAGS_panel-mipi-dsi.o := -I\$(src)" >> "$MAKEFILE"
+fi
 # Add it to the Kconfig
 KCONFIG="$KERNEL_DIR/drivers/gpu/drm/panel/Kconfig"
 if grep -q "config DRM_PANEL_MIPI_DSI" "$KCONFIG"; then
@@ -45,6 +49,8 @@ else
     echo "config DRM_PANEL_MIPI_DSI" >> "$KCONFIG"
     echo "	tristate \"MIPI DSI panel support\"" >> "$KCONFIG"
     echo "	depends on DRM_MIPI_DSI" >> "$KCONFIG"
+    echo "	select DRM_DISPLAY_DSC_HELPER" >> "$KCONFIG"
+    echo "	select DRM_DISPLAY_HELPER" >> "$KCONFIG"
     echo "	default n" >> "$KCONFIG"
     echo "	help" >> "$KCONFIG"
     echo "	  Support for MIPI DSI panels." >> "$KCONFIG"
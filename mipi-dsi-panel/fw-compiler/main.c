@@ -0,0 +1,817 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Has to match struct mipi_dsi_panel_fw_header in panel-mipi-dsi.c */
+#define FW_MAGIC            0x50495344 /* "DSIP" */
+#define FW_VERSION          1
+#define FW_HEADER_SIZE      56
+#define FW_CRC_OFFSET       16
+#define FW_FLAG_INIT_LPM    0x1
+#define FW_FLAG_INIT_HS     0x2
+#define FW_FLAG_INIT_LP_UNTIL_SLEEP_OUT 0x4
+#define FW_FLAG_INIT_XFER   (FW_FLAG_INIT_LPM | FW_FLAG_INIT_HS | FW_FLAG_INIT_LP_UNTIL_SLEEP_OUT)
+#define FW_FLAG_CMD_MODE    0x8
+
+#define DRM_MODE_FLAG_PHSYNC    (1 << 0)
+#define DRM_MODE_FLAG_NHSYNC    (1 << 1)
+#define DRM_MODE_FLAG_PVSYNC    (1 << 2)
+#define DRM_MODE_FLAG_NVSYNC    (1 << 3)
+
+#define MAX_SEQ_SIZE        65536
+#define MAX_LINE            4096
+#define MAX_REFRESH         16
+#define MAX_NAME            64
+#define MAX_SUPPLIES        8
+#define MAX_CHECKS          16
+#define MAX_SNAPSHOT        16  /* MIPI_DSI_PANEL_SNAPSHOT_REGS */
+#define MAX_PAGE            7   /* MIPI_DSI_PANEL_SHADOW_PAGE_LEN */
+
+/* Same range as the driver accepts */
+#define MIN_VREFRESH        10
+#define MAX_VREFRESH        240
+
+struct panel {
+    unsigned long clock;
+    unsigned long hactive, hfront_porch, hsync_len, hback_porch;
+    unsigned long vactive, vfront_porch, vsync_len, vback_porch;
+    unsigned long width_mm, height_mm;
+    unsigned long mode_flags;
+    unsigned long power_on_delay, reset_delay, sleep_delay;
+    unsigned long flags;
+
+    /* Only used for the checks and the C output, the blob keeps the driver's */
+    unsigned long lanes, bpp, lane_rate;
+    unsigned long refresh[MAX_REFRESH];
+    size_t num_refresh;
+    char name[MAX_NAME];
+
+    /* Only used for the C output, a blob can't change these */
+    unsigned long dsi_flags;
+    int has_dsi_flags;
+    char supplies[MAX_SUPPLIES][MAX_NAME];
+    size_t num_supplies;
+    int has_supplies;
+    unsigned long page_cmd;
+    uint8_t user_page[MAX_PAGE];
+    size_t user_page_len;
+    uint8_t verify[MAX_CHECKS][3];
+    size_t num_verify;
+    uint8_t esd_check[3];
+    int has_esd_check;
+    uint8_t snapshot[MAX_SNAPSHOT];
+    size_t num_snapshot;
+    unsigned long fast_power_on, fast_reset, fast_sleep_out, fast_step, fast_poll;
+    int has_fast;
+    int has_backlight;
+
+    uint8_t seq[MAX_SEQ_SIZE];
+    size_t seq_len;
+};
+
+/* Keywords of dsi-flags, in the order they are written with -c */
+static const struct {
+    const char *name;
+    const char *macro;
+} dsi_flags[] = {
+    { "video", "MIPI_DSI_MODE_VIDEO" },
+    { "burst", "MIPI_DSI_MODE_VIDEO_BURST" },
+    { "sync-pulse", "MIPI_DSI_MODE_VIDEO_SYNC_PULSE" },
+    { "auto-vert", "MIPI_DSI_MODE_VIDEO_AUTO_VERT" },
+    { "hse", "MIPI_DSI_MODE_VIDEO_HSE" },
+    { "no-hfp", "MIPI_DSI_MODE_VIDEO_NO_HFP" },
+    { "no-hbp", "MIPI_DSI_MODE_VIDEO_NO_HBP" },
+    { "no-hsa", "MIPI_DSI_MODE_VIDEO_NO_HSA" },
+    { "no-eot", "MIPI_DSI_MODE_NO_EOT_PACKET" },
+    { "clock-non-continuous", "MIPI_DSI_CLOCK_NON_CONTINUOUS" },
+    { "lpm", "MIPI_DSI_MODE_LPM" },
+};
+
+static void usage(void)
+{
+    printf ("\npanel-fw-compiler [-c] INPUT OUTPUT\n\n"
+            "Compile a text description of a panel into a firmware blob\n"
+            "for panel-mipi-dsi. See README.md for the input format.\n\n"
+            "  -c write the mode, init sequence and descriptor as C tables\n"
+            "     for panel-mipi-dsi.c instead of a firmware blob\n\n");
+}
+
+static uint32_t crc32(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xffffffff;
+
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+
+    return ~crc;
+}
+
+static void put_le16(uint8_t *p, unsigned long val)
+{
+    p[0] = val & 0xff;
+    p[1] = (val >> 8) & 0xff;
+}
+
+static void put_le32(uint8_t *p, unsigned long val)
+{
+    put_le16(p, val & 0xffff);
+    put_le16(p + 2, (val >> 16) & 0xffff);
+}
+
+static int parse_number(const char *file, unsigned int lineno, const char *str,
+                        unsigned long max, unsigned long *val)
+{
+    char *end;
+
+    if (!str) {
+        fprintf(stderr, "%s:%u: missing value\n", file, lineno);
+        return -1;
+    }
+
+    *val = strtoul(str, &end, 0);
+    if (*end != '\0' || *val > max) {
+        fprintf(stderr, "%s:%u: invalid value %s\n", file, lineno, str);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Hex bytes up to the end of the line, at least one */
+static int parse_bytes(const char *file, unsigned int lineno, char *arg,
+                       uint8_t *bytes, size_t max, size_t *len)
+{
+    for (*len = 0; arg; arg = strtok(NULL, " \t"), (*len)++) {
+        char *end;
+
+        if (*len == max) {
+            fprintf(stderr, "%s:%u: too many bytes\n", file, lineno);
+            return -1;
+        }
+        bytes[*len] = strtoul(arg, &end, 16);
+        if (*end != '\0' || strlen(arg) > 2) {
+            fprintf(stderr, "%s:%u: invalid byte %s\n", file, lineno, arg);
+            return -1;
+        }
+    }
+    if (!*len) {
+        fprintf(stderr, "%s:%u: missing value\n", file, lineno);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int seq_append(struct panel *panel, const char *file, unsigned int lineno,
+                      const uint8_t *data, size_t len)
+{
+    if (panel->seq_len + len > MAX_SEQ_SIZE) {
+        fprintf(stderr, "%s:%u: init sequence too long\n", file, lineno);
+        return -1;
+    }
+
+    memcpy(&panel->seq[panel->seq_len], data, len);
+    panel->seq_len += len;
+
+    return 0;
+}
+
+static int parse_line(struct panel *panel, const char *file, unsigned int lineno,
+                      char *line)
+{
+    static const struct {
+        const char *name;
+        size_t offset;
+        unsigned long max;
+    } keys[] = {
+        { "clock", offsetof(struct panel, clock), 0xffffffff },
+        { "hactive", offsetof(struct panel, hactive), 0xffff },
+        { "hfront-porch", offsetof(struct panel, hfront_porch), 0xffff },
+        { "hsync-len", offsetof(struct panel, hsync_len), 0xffff },
+        { "hback-porch", offsetof(struct panel, hback_porch), 0xffff },
+        { "vactive", offsetof(struct panel, vactive), 0xffff },
+        { "vfront-porch", offsetof(struct panel, vfront_porch), 0xffff },
+        { "vsync-len", offsetof(struct panel, vsync_len), 0xffff },
+        { "vback-porch", offsetof(struct panel, vback_porch), 0xffff },
+        { "width-mm", offsetof(struct panel, width_mm), 0xffff },
+        { "height-mm", offsetof(struct panel, height_mm), 0xffff },
+        { "power-on-delay", offsetof(struct panel, power_on_delay), 0xffff },
+        { "reset-delay", offsetof(struct panel, reset_delay), 0xffff },
+        { "sleep-delay", offsetof(struct panel, sleep_delay), 0xffff },
+        { "lanes", offsetof(struct panel, lanes), 4 },
+        { "bpp", offsetof(struct panel, bpp), 24 },
+        { "lane-rate", offsetof(struct panel, lane_rate), 10000 },
+        { "fast-power-on", offsetof(struct panel, fast_power_on), 0xffffffff },
+        { "fast-reset", offsetof(struct panel, fast_reset), 0xffffffff },
+        { "fast-sleep-out", offsetof(struct panel, fast_sleep_out), 0xffffffff },
+        { "fast-step", offsetof(struct panel, fast_step), 0xffffffff },
+        { "fast-poll-power-mode", offsetof(struct panel, fast_poll), 1 },
+    };
+    char *key = strtok(line, " \t");
+    char *arg = strtok(NULL, " \t");
+    unsigned long val;
+    uint8_t cmd[256];
+    size_t len;
+
+    if (!key)
+        return 0;
+
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        if (!strcmp(key, keys[i].name)) {
+            if (!strncmp(key, "fast-", 5))
+                panel->has_fast = 1;
+            return parse_number(file, lineno, arg, keys[i].max,
+                                (unsigned long *)((char *)panel + keys[i].offset));
+        }
+    }
+
+    if (!strcmp(key, "hsync-active") || !strcmp(key, "vsync-active")) {
+        int h = key[0] == 'h';
+
+        if (parse_number(file, lineno, arg, 1, &val))
+            return -1;
+        panel->mode_flags &= h ? ~(DRM_MODE_FLAG_PHSYNC | DRM_MODE_FLAG_NHSYNC) :
+                                 ~(DRM_MODE_FLAG_PVSYNC | DRM_MODE_FLAG_NVSYNC);
+        if (h)
+            panel->mode_flags |= val ? DRM_MODE_FLAG_PHSYNC : DRM_MODE_FLAG_NHSYNC;
+        else
+            panel->mode_flags |= val ? DRM_MODE_FLAG_PVSYNC : DRM_MODE_FLAG_NVSYNC;
+        return 0;
+    }
+
+    /* Only one transfer mode, the last one given wins */
+    if (!strcmp(key, "init-lpm")) {
+        panel->flags = (panel->flags & ~FW_FLAG_INIT_XFER) | FW_FLAG_INIT_LPM;
+        return 0;
+    }
+
+    if (!strcmp(key, "init-hs")) {
+        panel->flags = (panel->flags & ~FW_FLAG_INIT_XFER) | FW_FLAG_INIT_HS;
+        return 0;
+    }
+
+    if (!strcmp(key, "init-lp-until-sleep-out")) {
+        panel->flags = (panel->flags & ~FW_FLAG_INIT_XFER) | FW_FLAG_INIT_LP_UNTIL_SLEEP_OUT;
+        return 0;
+    }
+
+    if (!strcmp(key, "command-mode")) {
+        panel->flags |= FW_FLAG_CMD_MODE;
+        return 0;
+    }
+
+    if (!strcmp(key, "dsi-flags")) {
+        for (; arg; arg = strtok(NULL, " \t")) {
+            size_t i;
+
+            for (i = 0; i < sizeof(dsi_flags) / sizeof(dsi_flags[0]); i++) {
+                if (!strcmp(arg, dsi_flags[i].name))
+                    break;
+            }
+            if (i == sizeof(dsi_flags) / sizeof(dsi_flags[0])) {
+                fprintf(stderr, "%s:%u: unknown DSI flag %s\n", file, lineno, arg);
+                return -1;
+            }
+            panel->dsi_flags |= 1UL << i;
+        }
+        panel->has_dsi_flags = 1;
+        return 0;
+    }
+
+    /* Without names the panel has no supplies */
+    if (!strcmp(key, "supplies")) {
+        for (panel->num_supplies = 0; arg; arg = strtok(NULL, " \t")) {
+            if (panel->num_supplies == MAX_SUPPLIES || strlen(arg) >= MAX_NAME ||
+                strchr(arg, '"') || strchr(arg, '\\')) {
+                fprintf(stderr, "%s:%u: invalid supply %s\n", file, lineno, arg);
+                return -1;
+            }
+            strcpy(panel->supplies[panel->num_supplies++], arg);
+        }
+        panel->has_supplies = 1;
+        return 0;
+    }
+
+    if (!strcmp(key, "page-cmd")) {
+        if (parse_bytes(file, lineno, arg, cmd, 1, &len))
+            return -1;
+        panel->page_cmd = cmd[0];
+        return 0;
+    }
+
+    if (!strcmp(key, "user-page"))
+        return parse_bytes(file, lineno, arg, panel->user_page, MAX_PAGE,
+                           &panel->user_page_len);
+
+    if (!strcmp(key, "verify") || !strcmp(key, "esd-check")) {
+        int verify = key[0] == 'v';
+
+        if (verify && panel->num_verify == MAX_CHECKS) {
+            fprintf(stderr, "%s:%u: too many registers to verify\n", file, lineno);
+            return -1;
+        }
+        if (parse_bytes(file, lineno, arg, cmd, 3, &len))
+            return -1;
+        if (len != 3) {
+            fprintf(stderr, "%s:%u: expected register, mask and value\n", file, lineno);
+            return -1;
+        }
+        memcpy(verify ? panel->verify[panel->num_verify++] : panel->esd_check, cmd, 3);
+        if (!verify)
+            panel->has_esd_check = 1;
+        return 0;
+    }
+
+    if (!strcmp(key, "snapshot"))
+        return parse_bytes(file, lineno, arg, panel->snapshot, MAX_SNAPSHOT,
+                           &panel->num_snapshot);
+
+    if (!strcmp(key, "backlight")) {
+        panel->has_backlight = 1;
+        return 0;
+    }
+
+    if (!strcmp(key, "name")) {
+        if (!arg || strlen(arg) >= MAX_NAME || strspn(arg, "abcdefghijklmnopqrstuvwxyz"
+                                                      "0123456789_") != strlen(arg)) {
+            fprintf(stderr, "%s:%u: name must be a lower case C identifier\n", file, lineno);
+            return -1;
+        }
+        strcpy(panel->name, arg);
+        return 0;
+    }
+
+    if (!strcmp(key, "refresh")) {
+        for (; arg; arg = strtok(NULL, " \t")) {
+            if (panel->num_refresh == MAX_REFRESH) {
+                fprintf(stderr, "%s:%u: too many refresh rates\n", file, lineno);
+                return -1;
+            }
+            if (parse_number(file, lineno, arg, 0xffff, &panel->refresh[panel->num_refresh++]))
+                return -1;
+        }
+        if (!panel->num_refresh) {
+            fprintf(stderr, "%s:%u: missing value\n", file, lineno);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (!strcmp(key, "delay")) {
+        uint8_t delay[3] = { 0 };
+
+        if (parse_number(file, lineno, arg, 0xffff, &val))
+            return -1;
+        put_le16(&delay[1], val);
+        return seq_append(panel, file, lineno, delay, sizeof(delay));
+    }
+
+    if (!strcmp(key, "cmd")) {
+        /* Length byte followed by the DCS command and its parameters */
+        if (parse_bytes(file, lineno, arg, &cmd[1], sizeof(cmd) - 1, &len))
+            return -1;
+        cmd[0] = len;
+        return seq_append(panel, file, lineno, cmd, len + 1);
+    }
+
+    fprintf(stderr, "%s:%u: unknown keyword %s\n", file, lineno, key);
+
+    return -1;
+}
+
+static uint64_t htotal(const struct panel *panel)
+{
+    return panel->hactive + panel->hfront_porch + panel->hsync_len + panel->hback_porch;
+}
+
+static uint64_t vtotal(const struct panel *panel)
+{
+    return panel->vactive + panel->vfront_porch + panel->vsync_len + panel->vback_porch;
+}
+
+/* Pixel clock in kHz times bits per pixel is kbps, spread over the lanes */
+static uint64_t lane_kbps(const struct panel *panel, uint64_t clock)
+{
+    return (clock * panel->bpp + panel->lanes - 1) / panel->lanes;
+}
+
+/*
+ * Same checks as the driver does at probe. With refresh instead of clock the
+ * highest of the given rates that fits into lane-rate is picked, rounding the
+ * clock up so the panel is never slower than asked for.
+ */
+static int check_panel(struct panel *panel, const char *file)
+{
+    uint64_t total, clock, refresh;
+
+    if (panel->clock && panel->num_refresh) {
+        fprintf(stderr, "%s: either clock or refresh can be given\n", file);
+        return -1;
+    }
+
+    if (!panel->clock && !panel->num_refresh)
+        return 0;
+
+    if (!panel->hactive || !panel->vactive) {
+        fprintf(stderr, "%s: clock given without hactive and vactive\n", file);
+        return -1;
+    }
+
+    if (!panel->hfront_porch || !panel->hsync_len || !panel->hback_porch ||
+        !panel->vfront_porch || !panel->vsync_len || !panel->vback_porch) {
+        fprintf(stderr, "%s: porches and sync pulses must not be 0\n", file);
+        return -1;
+    }
+
+    if (panel->bpp != 16 && panel->bpp != 18 && panel->bpp != 24) {
+        fprintf(stderr, "%s: bpp must be 16, 18 or 24\n", file);
+        return -1;
+    }
+
+    if (!panel->lanes) {
+        fprintf(stderr, "%s: at least one lane is needed\n", file);
+        return -1;
+    }
+
+    total = htotal(panel) * vtotal(panel);
+
+    for (size_t i = 0; i < panel->num_refresh; i++) {
+        if (panel->refresh[i] < MIN_VREFRESH || panel->refresh[i] > MAX_VREFRESH) {
+            fprintf(stderr, "%s: refresh rate %lu Hz out of range\n", file,
+                    panel->refresh[i]);
+            return -1;
+        }
+        clock = (total * panel->refresh[i] + 999) / 1000;
+        if (panel->lane_rate && lane_kbps(panel, clock) > panel->lane_rate * 1000)
+            continue;
+        if (clock > panel->clock)
+            panel->clock = clock;
+    }
+
+    if (!panel->clock) {
+        fprintf(stderr, "%s: none of the refresh rates fits into %lu lanes at %lu Mbps\n",
+                file, panel->lanes, panel->lane_rate);
+        return -1;
+    }
+
+    refresh = (panel->clock * 1000 + total / 2) / total;
+    if (refresh < MIN_VREFRESH || refresh > MAX_VREFRESH) {
+        fprintf(stderr, "%s: refresh rate %llu Hz out of range\n", file,
+                (unsigned long long)refresh);
+        return -1;
+    }
+
+    if (panel->lane_rate && lane_kbps(panel, panel->clock) > panel->lane_rate * 1000) {
+        fprintf(stderr, "%s: %lu kHz needs %llu kbps per lane, lane-rate is %lu Mbps\n",
+                file, panel->clock, (unsigned long long)lane_kbps(panel, panel->clock),
+                panel->lane_rate);
+        return -1;
+    }
+
+    printf("%lux%lu@%llu, %lu kHz, %llu kbps per lane\n", panel->hactive, panel->vactive,
+           (unsigned long long)refresh, panel->clock,
+           (unsigned long long)lane_kbps(panel, panel->clock));
+
+    return 0;
+}
+
+static int write_blob(const struct panel *panel, const char *file)
+{
+    size_t size = FW_HEADER_SIZE + panel->seq_len;
+    uint8_t *blob = calloc(1, size);
+    uint8_t *p = blob;
+    FILE *out;
+    int ret = 0;
+
+    if (!blob) {
+        fprintf(stderr, "Could not allocate memory\n");
+        return -1;
+    }
+
+    put_le32(p, FW_MAGIC);
+    put_le16(p + 4, FW_VERSION);
+    put_le16(p + 6, FW_HEADER_SIZE);
+    put_le32(p + 8, size);
+    /* crc32 at 12 is filled in below */
+
+    if (panel->clock) {
+        put_le32(p + 16, panel->clock);
+        put_le16(p + 20, panel->hactive);
+        put_le16(p + 22, panel->hactive + panel->hfront_porch);
+        put_le16(p + 24, panel->hactive + panel->hfront_porch + panel->hsync_len);
+        put_le16(p + 26, panel->hactive + panel->hfront_porch + panel->hsync_len +
+                         panel->hback_porch);
+        put_le16(p + 28, panel->vactive);
+        put_le16(p + 30, panel->vactive + panel->vfront_porch);
+        put_le16(p + 32, panel->vactive + panel->vfront_porch + panel->vsync_len);
+        put_le16(p + 34, panel->vactive + panel->vfront_porch + panel->vsync_len +
+                         panel->vback_porch);
+        put_le16(p + 36, panel->width_mm);
+        put_le16(p + 38, panel->height_mm);
+        put_le32(p + 40, panel->mode_flags);
+    }
+
+    put_le16(p + 44, panel->power_on_delay);
+    put_le16(p + 46, panel->reset_delay);
+    put_le16(p + 48, panel->sleep_delay);
+    put_le16(p + 50, panel->flags);
+    put_le32(p + 52, panel->seq_len);
+
+    memcpy(p + FW_HEADER_SIZE, panel->seq, panel->seq_len);
+    put_le32(p + 12, crc32(p + FW_CRC_OFFSET, size - FW_CRC_OFFSET));
+
+    out = fopen(file, "wb");
+    if (!out || fwrite(blob, 1, size, out) != size) {
+        fprintf(stderr, "Could not write %s\n", file);
+        ret = -1;
+    }
+    if (out && fclose(out)) {
+        fprintf(stderr, "Could not write %s\n", file);
+        ret = -1;
+    }
+
+    free(blob);
+
+    return ret;
+}
+
+static const char *dcs_name(uint8_t cmd)
+{
+    switch (cmd) {
+    case 0x11:
+        return "MIPI_DCS_EXIT_SLEEP_MODE";
+    case 0x29:
+        return "MIPI_DCS_SET_DISPLAY_ON";
+    default:
+        return NULL;
+    }
+}
+
+/* Tables in the style of the built-in descriptors of panel-mipi-dsi.c */
+static int write_c(const struct panel *panel, const char *input, const char *file)
+{
+    static const char *const formats[] = {
+        [16] = "MIPI_DSI_FMT_RGB565",
+        [18] = "MIPI_DSI_FMT_RGB666_PACKED",
+        [24] = "MIPI_DSI_FMT_RGB888",
+    };
+    const char *name = panel->name[0] ? panel->name : "panel";
+    size_t pos = 0;
+    FILE *out;
+    int ret = 0;
+
+    /* The driver has no defaults for these, a guess would silently differ */
+    if (!panel->has_dsi_flags || !panel->has_supplies) {
+        fprintf(stderr, "%s: -c needs dsi-flags and supplies\n", input);
+        return -1;
+    }
+
+    if (panel->user_page_len && !panel->page_cmd) {
+        fprintf(stderr, "%s: user-page needs page-cmd\n", input);
+        return -1;
+    }
+
+    out = fopen(file, "w");
+    if (!out) {
+        fprintf(stderr, "Could not write %s\n", file);
+        return -1;
+    }
+
+    fprintf(out, "/* Generated by panel-fw-compiler from %s */\n", input);
+
+    if (panel->clock) {
+        fprintf(out, "static const struct drm_display_mode %s_mode = {\n", name);
+        fprintf(out, "\t.clock\t\t= %lu,\n\n", panel->clock);
+        fprintf(out, "\t.hdisplay\t= %lu,\n", panel->hactive);
+        fprintf(out, "\t.hsync_start\t= %lu + %lu,\n", panel->hactive, panel->hfront_porch);
+        fprintf(out, "\t.hsync_end\t= %lu + %lu + %lu,\n", panel->hactive,
+                panel->hfront_porch, panel->hsync_len);
+        fprintf(out, "\t.htotal\t\t= %lu + %lu + %lu + %lu,\n\n", panel->hactive,
+                panel->hfront_porch, panel->hsync_len, panel->hback_porch);
+        fprintf(out, "\t.vdisplay\t= %lu,\n", panel->vactive);
+        fprintf(out, "\t.vsync_start\t= %lu + %lu,\n", panel->vactive, panel->vfront_porch);
+        fprintf(out, "\t.vsync_end\t= %lu + %lu + %lu,\n", panel->vactive,
+                panel->vfront_porch, panel->vsync_len);
+        fprintf(out, "\t.vtotal\t\t= %lu + %lu + %lu + %lu,\n\n", panel->vactive,
+                panel->vfront_porch, panel->vsync_len, panel->vback_porch);
+        fprintf(out, "\t.width_mm\t= %lu,\n", panel->width_mm);
+        fprintf(out, "\t.height_mm\t= %lu,\n\n", panel->height_mm);
+        fprintf(out, "\t.type = DRM_MODE_TYPE_DRIVER | DRM_MODE_TYPE_PREFERRED,\n");
+        fprintf(out, "\t.flags = %s | %s,\n",
+                panel->mode_flags & DRM_MODE_FLAG_PHSYNC ? "DRM_MODE_FLAG_PHSYNC" :
+                                                           "DRM_MODE_FLAG_NHSYNC",
+                panel->mode_flags & DRM_MODE_FLAG_PVSYNC ? "DRM_MODE_FLAG_PVSYNC" :
+                                                           "DRM_MODE_FLAG_NVSYNC");
+        fprintf(out, "};\n\n");
+    }
+
+    fprintf(out, "static const u8 %s_init_seq[] = {\n", name);
+    while (pos < panel->seq_len) {
+        uint8_t len = panel->seq[pos++];
+
+        if (!len) {
+            fprintf(out, "\tMIPI_DSI_SEQ_DELAY(%u),\n",
+                    panel->seq[pos] | panel->seq[pos + 1] << 8);
+            pos += 2;
+            continue;
+        }
+
+        fprintf(out, "\tMIPI_DSI_SEQ_CMD(");
+        if (len == 1 && dcs_name(panel->seq[pos]))
+            fprintf(out, "%s", dcs_name(panel->seq[pos]));
+        else
+            for (uint8_t i = 0; i < len; i++)
+                fprintf(out, "%s0x%02X", i ? ", " : "", panel->seq[pos + i]);
+        fprintf(out, "),\n");
+        pos += len;
+    }
+    fprintf(out, "};\n\n");
+
+    if (panel->num_snapshot) {
+        fprintf(out, "static const u8 %s_snapshot[] = {\n", name);
+        for (size_t i = 0; i < panel->num_snapshot; i++)
+            fprintf(out, "\t0x%02X,\n", panel->snapshot[i]);
+        fprintf(out, "};\n\n");
+    }
+
+    if (panel->user_page_len) {
+        fprintf(out, "static const u8 %s_user_page[] = {\n", name);
+        fprintf(out, "\tMIPI_DSI_SEQ_CMD(0x%02lX", panel->page_cmd);
+        for (size_t i = 0; i < panel->user_page_len; i++)
+            fprintf(out, ", 0x%02X", panel->user_page[i]);
+        fprintf(out, "),\n};\n\n");
+    }
+
+    if (panel->num_verify) {
+        fprintf(out, "static const struct mipi_dsi_panel_reg_check %s_verify[] = {\n", name);
+        for (size_t i = 0; i < panel->num_verify; i++)
+            fprintf(out, "\t{ 0x%02X, 0x%02X, 0x%02X },\n", panel->verify[i][0],
+                    panel->verify[i][1], panel->verify[i][2]);
+        fprintf(out, "};\n\n");
+    }
+
+    if (panel->has_esd_check)
+        fprintf(out, "static const struct mipi_dsi_panel_reg_check %s_esd_check = "
+                "{ 0x%02X, 0x%02X, 0x%02X };\n\n", name, panel->esd_check[0],
+                panel->esd_check[1], panel->esd_check[2]);
+
+    if (panel->has_fast) {
+        fprintf(out, "static const struct mipi_dsi_panel_fast_delays %s_fast = {\n", name);
+        fprintf(out, "\t.power_on = %lu,\n", panel->fast_power_on);
+        fprintf(out, "\t.reset = %lu,\n", panel->fast_reset);
+        fprintf(out, "\t.sleep_out = %lu,\n", panel->fast_sleep_out);
+        fprintf(out, "\t.step = %lu,\n", panel->fast_step);
+        fprintf(out, "\t.poll_power_mode = %s,\n", panel->fast_poll ? "true" : "false");
+        fprintf(out, "};\n\n");
+    }
+
+    if (panel->num_supplies) {
+        fprintf(out, "static const char * const %s_supply_names[] = {\n", name);
+        for (size_t i = 0; i < panel->num_supplies; i++)
+            fprintf(out, "\t\"%s\",\n", panel->supplies[i]);
+        fprintf(out, "};\n\n");
+    }
+
+    if (panel->power_on_delay != 20 || panel->reset_delay != 150)
+        fprintf(out, "/* power-on-delay and reset-delay are only taken from firmware */\n");
+    fprintf(out, "static const struct mipi_dsi_panel_panel_desc %s_desc = {\n", name);
+    if (panel->clock)
+        fprintf(out, "\t.mode = &%s_mode,\n", name);
+    fprintf(out, "\t.lanes = %lu,\n", panel->lanes);
+    fprintf(out, "\t.flags = ");
+    for (size_t i = 0, n = 0; i < sizeof(dsi_flags) / sizeof(dsi_flags[0]); i++) {
+        if (panel->dsi_flags & (1UL << i))
+            fprintf(out, "%s%s", n++ ? " | " : "", dsi_flags[i].macro);
+    }
+    fprintf(out, "%s,\n", panel->dsi_flags ? "" : "0");
+    fprintf(out, "\t.format = %s,\n", formats[panel->bpp]);
+    if (panel->num_supplies) {
+        fprintf(out, "\t.supply_names = %s_supply_names,\n", name);
+        fprintf(out, "\t.num_supplies = ARRAY_SIZE(%s_supply_names),\n", name);
+    }
+    fprintf(out, "\t.panel_sleep_delay = %lu,\n", panel->sleep_delay);
+    fprintf(out, "\t.init_seq = MIPI_DSI_PANEL_SEQ(%s_init_seq),\n", name);
+    if (panel->flags & FW_FLAG_INIT_LPM)
+        fprintf(out, "\t.init_xfer = MIPI_DSI_PANEL_XFER_LP,\n");
+    else if (panel->flags & FW_FLAG_INIT_HS)
+        fprintf(out, "\t.init_xfer = MIPI_DSI_PANEL_XFER_HS,\n");
+    else if (panel->flags & FW_FLAG_INIT_LP_UNTIL_SLEEP_OUT)
+        fprintf(out, "\t.init_xfer = MIPI_DSI_PANEL_XFER_LP_UNTIL_SLEEP_OUT,\n");
+    if (panel->flags & FW_FLAG_CMD_MODE)
+        fprintf(out, "\t.cmd_mode = true,\n");
+    if (panel->num_verify) {
+        fprintf(out, "\t.verify = %s_verify,\n", name);
+        fprintf(out, "\t.num_verify = ARRAY_SIZE(%s_verify),\n", name);
+    }
+    if (panel->has_fast)
+        fprintf(out, "\t.fast = &%s_fast,\n", name);
+    if (panel->page_cmd)
+        fprintf(out, "\t.page_cmd = 0x%02lX,\n", panel->page_cmd);
+    if (panel->user_page_len)
+        fprintf(out, "\t.user_page = MIPI_DSI_PANEL_SEQ(%s_user_page),\n", name);
+    if (panel->has_esd_check)
+        fprintf(out, "\t.esd_check = &%s_esd_check,\n", name);
+    if (panel->num_snapshot) {
+        fprintf(out, "\t.snapshot_regs = %s_snapshot,\n", name);
+        fprintf(out, "\t.num_snapshot_regs = ARRAY_SIZE(%s_snapshot),\n", name);
+    }
+    if (panel->lane_rate)
+        fprintf(out, "\t.max_lane_rate = %lu,\n", panel->lane_rate * 1000);
+    fprintf(out, "\t.panel_has_backlight = %s\n", panel->has_backlight ? "true" : "false");
+    fprintf(out, "};\n");
+
+    if (ferror(out) | fclose(out)) {
+        fprintf(stderr, "Could not write %s\n", file);
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    struct panel *panel;
+    char line[MAX_LINE];
+    unsigned int lineno = 0;
+    const char *input, *output;
+    int c_output = 0;
+    FILE *in;
+    int ret = 0;
+
+    if (argc == 4 && !strcmp(argv[1], "-c")) {
+        c_output = 1;
+        argv++;
+        argc--;
+    }
+
+    if (argc != 3) {
+        usage();
+        return 1;
+    }
+    input = argv[1];
+    output = argv[2];
+
+    panel = calloc(1, sizeof(*panel));
+    if (!panel) {
+        fprintf(stderr, "Could not allocate memory\n");
+        return 2;
+    }
+
+    /* Same defaults as the driver uses without firmware */
+    panel->power_on_delay = 20;
+    panel->reset_delay = 150;
+    panel->sleep_delay = 200;
+    panel->lanes = 4;
+    panel->bpp = 24;
+
+    in = fopen(input, "r");
+    if (!in) {
+        fprintf(stderr, "Could not open %s\n", input);
+        free(panel);
+        return 2;
+    }
+
+    while (fgets(line, sizeof(line), in)) {
+        char *comment = strchr(line, '#');
+
+        lineno++;
+        if (comment)
+            *comment = '\0';
+        line[strcspn(line, "\r\n")] = '\0';
+        if (parse_line(panel, input, lineno, line)) {
+            ret = 3;
+            break;
+        }
+    }
+    fclose(in);
+
+    if (!ret && check_panel(panel, input))
+        ret = 3;
+
+    if (!ret && (c_output ? write_c(panel, input, output) : write_blob(panel, output)))
+        ret = 2;
+
+    free(panel);
+
+    return ret;
+}
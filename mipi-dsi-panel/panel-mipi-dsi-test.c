@@ -0,0 +1,846 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * KUnit tests for panel-mipi-dsi. The driver is built into this module and
+ * bound to a DSI device on a mock host, the host records every transfer as
+ * one line of text. Reset GPIO changes and the steps of the test are recorded
+ * in between, the stream of each built-in panel is compared with
+ * golden/<panel>.txt.
+ *
+ * The Makefile builds panel-mipi-dsi-kunit.ko if the kernel has CONFIG_KUNIT.
+ * The results show up in the kernel log and in
+ * /sys/kernel/debug/kunit/panel-mipi-dsi/results once the module is loaded.
+ * The test driver only binds the devices this module registers, the suite can
+ * be loaded next to panel-mipi-dsi.ko. Regulators are not mocked, the supplies
+ * of the built-in panels need the dummy regulator of a kernel with a device
+ * tree.
+ */
+#define NOTRACE
+#define PANEL_MIPI_DSI_KUNIT
+#include "panel-mipi-dsi.c"
+
+#include <kunit/test.h>
+#include <linux/gpio/driver.h>
+#include <linux/gpio/machine.h>
+#include <linux/of.h>
+
+/* Also the type of the DSI device, which takes at most 19 characters */
+#define PANEL_TEST_NAME		"panel-dsi-kunit"
+#define PANEL_TEST_LOG_SIZE	SZ_16K
+/* %*ph prints at most 64 bytes */
+#define PANEL_TEST_LOG_BYTES	64
+#define PANEL_TEST_PROPS	8
+
+struct panel_test {
+	struct device *dev;
+	struct mipi_dsi_host host;
+	bool host_added;
+	struct gpio_chip gpio;
+	bool gpio_added;
+	struct mipi_dsi_device *dsi;
+	struct mipi_dsi_panel *dsi_panel;
+
+	/* Properties of the panel node, the node has no compatible */
+	struct device_node np;
+	struct property props[PANEL_TEST_PROPS];
+	unsigned int num_props;
+
+	/* Protects everything below, bl_work sends from a worker */
+	spinlock_t lock;
+	char *log;
+	size_t log_len;
+
+	/* The next fail_writes writes starting with fail_cmd fail with -EIO */
+	u8 fail_cmd;
+	unsigned int fail_writes;
+	/* Reads fail with this if set, else return regs[] or the power mode */
+	int read_ret;
+	u8 regs[256];
+	u8 power_mode;
+	/* attach fails while dsi->dsc is set */
+	bool refuse_dsc;
+};
+
+static const struct mipi_dsi_panel_panel_desc *panel_test_desc;
+
+static __printf(2, 3) void panel_test_log(struct panel_test *t, const char *fmt, ...)
+{
+	va_list args;
+
+	spin_lock(&t->lock);
+	va_start(args, fmt);
+	t->log_len += vscnprintf(t->log + t->log_len, PANEL_TEST_LOG_SIZE - t->log_len,
+				 fmt, args);
+	va_end(args);
+	spin_unlock(&t->lock);
+}
+
+static void panel_test_clear_log(struct panel_test *t)
+{
+	spin_lock(&t->lock);
+	t->log_len = 0;
+	t->log[0] = '\0';
+	spin_unlock(&t->lock);
+}
+
+/* Each step of a test starts with "# <step>" in the stream */
+static void panel_test_step(struct panel_test *t, const char *step)
+{
+	panel_test_log(t, "# %s\n", step);
+}
+
+/* The bits of the power mode the DCS commands change, reset clears them */
+static void panel_test_write(struct panel_test *t, const u8 *tx, size_t len)
+{
+	if (len != 1)
+		return;
+
+	switch (tx[0]) {
+	case MIPI_DCS_EXIT_SLEEP_MODE:
+		t->power_mode |= MIPI_DCS_POWER_MODE_SLEEP;
+		break;
+	case MIPI_DCS_ENTER_SLEEP_MODE:
+		t->power_mode &= ~MIPI_DCS_POWER_MODE_SLEEP;
+		break;
+	case MIPI_DCS_SET_DISPLAY_ON:
+		t->power_mode |= MIPI_DCS_POWER_MODE_DISPLAY;
+		break;
+	case MIPI_DCS_SET_DISPLAY_OFF:
+		t->power_mode &= ~MIPI_DCS_POWER_MODE_DISPLAY;
+		break;
+	}
+}
+
+static ssize_t panel_test_transfer(struct mipi_dsi_host *host, const struct mipi_dsi_msg *msg)
+{
+	struct panel_test *t = container_of(host, struct panel_test, host);
+	const u8 *tx = msg->tx_buf;
+	bool read = msg->type == MIPI_DSI_DCS_READ;
+	ssize_t ret;
+
+	spin_lock(&t->lock);
+	if (read) {
+		ret = t->read_ret;
+		if (!ret && msg->rx_len) {
+			*(u8 *)msg->rx_buf = tx[0] == MIPI_DCS_GET_POWER_MODE ?
+					     t->power_mode : t->regs[tx[0]];
+			ret = 1;
+		}
+	} else if (msg->tx_len && tx[0] == t->fail_cmd && t->fail_writes) {
+		t->fail_writes--;
+		ret = -EIO;
+	} else {
+		if (msg->tx_len)
+			panel_test_write(t, tx, msg->tx_len);
+		ret = msg->tx_len;
+	}
+	spin_unlock(&t->lock);
+
+	panel_test_log(t, "%02x %s %*ph%s", msg->type,
+		       msg->flags & MIPI_DSI_MSG_USE_LPM ? "lp" : "hs",
+		       (int)min_t(size_t, msg->tx_len, PANEL_TEST_LOG_BYTES), msg->tx_buf,
+		       msg->tx_len > PANEL_TEST_LOG_BYTES ? " ..." : "");
+	if (ret < 0)
+		panel_test_log(t, " (%zd)\n", ret);
+	else
+		panel_test_log(t, "\n");
+
+	return ret;
+}
+
+static int panel_test_attach(struct mipi_dsi_host *host, struct mipi_dsi_device *dsi)
+{
+	struct panel_test *t = container_of(host, struct panel_test, host);
+
+	return dsi->dsc && t->refuse_dsc ? -EOPNOTSUPP : 0;
+}
+
+static int panel_test_detach(struct mipi_dsi_host *host, struct mipi_dsi_device *dsi)
+{
+	return 0;
+}
+
+static const struct mipi_dsi_host_ops panel_test_host_ops = {
+	.attach = panel_test_attach,
+	.detach = panel_test_detach,
+	.transfer = panel_test_transfer,
+};
+
+static void panel_test_gpio_set(struct gpio_chip *gc, unsigned int offset, int value)
+{
+	struct panel_test *t = gpiochip_get_data(gc);
+
+	if (!value) {
+		spin_lock(&t->lock);
+		t->power_mode = 0;
+		spin_unlock(&t->lock);
+	}
+	panel_test_log(t, "reset %d\n", value);
+}
+
+static int panel_test_gpio_direction_output(struct gpio_chip *gc, unsigned int offset,
+					    int value)
+{
+	panel_test_gpio_set(gc, offset, value);
+
+	return 0;
+}
+
+static int panel_test_gpio_get_direction(struct gpio_chip *gc, unsigned int offset)
+{
+	return GPIO_LINE_DIRECTION_OUT;
+}
+
+/* The reset GPIO of every device this suite registers */
+static struct gpiod_lookup_table panel_test_gpios = {
+	.dev_id = PANEL_TEST_NAME ".0",
+	.table = {
+		GPIO_LOOKUP(PANEL_TEST_NAME, 0, "reset", GPIO_ACTIVE_HIGH),
+		{ }
+	},
+};
+
+static int panel_test_probe(struct mipi_dsi_device *dsi)
+{
+	return mipi_dsi_panel_probe_desc(dsi, panel_test_desc);
+}
+
+static struct mipi_dsi_driver panel_test_driver = {
+	.probe		= panel_test_probe,
+	.remove		= mipi_dsi_panel_remove,
+	.driver = {
+		.name		= PANEL_TEST_NAME,
+		.probe_type	= PROBE_FORCE_SYNCHRONOUS,
+		.pm		= &mipi_dsi_panel_pm_ops,
+	},
+};
+
+static void panel_test_set_prop(struct panel_test *t, const char *name,
+				const void *value, int length)
+{
+	struct property *prop;
+
+	if (WARN_ON(t->num_props == PANEL_TEST_PROPS))
+		return;
+
+	prop = &t->props[t->num_props++];
+	prop->name = (char *)name;
+	prop->value = (void *)value;
+	prop->length = length;
+	prop->next = t->np.properties;
+	t->np.properties = prop;
+}
+
+/* Register the panel on the mock host, the probe runs before this returns */
+static struct mipi_dsi_panel *panel_test_add(struct kunit *test,
+					     const struct mipi_dsi_panel_panel_desc *desc)
+{
+	struct panel_test *t = test->priv;
+	struct mipi_dsi_device_info info = {
+		.type = PANEL_TEST_NAME,
+		.channel = 0,
+		/* Dropped again when the device is released */
+		.node = of_node_get(&t->np),
+	};
+
+	panel_test_desc = desc;
+	t->dsi = mipi_dsi_device_register_full(&t->host, &info);
+	if (IS_ERR(t->dsi))
+		of_node_put(info.node);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, t->dsi);
+
+	t->dsi_panel = mipi_dsi_get_drvdata(t->dsi);
+	KUNIT_ASSERT_NOT_NULL_MSG(test, t->dsi_panel, "probe failed");
+	/* The reset GPIO was requested low, the stream starts at the first step */
+	panel_test_clear_log(t);
+
+	return t->dsi_panel;
+}
+
+static void panel_test_dump(struct kunit *test)
+{
+	struct panel_test *t = test->priv;
+	const char *line = t->log;
+	size_t len;
+
+	while (*line) {
+		len = strcspn(line, "\n");
+		kunit_info(test, "%.*s\n", (int)len, line);
+		line += len + (line[len] == '\n');
+	}
+}
+
+/* Compare line by line, the whole stream is printed on a mismatch */
+static void panel_test_expect_stream(struct kunit *test, const char *expected)
+{
+	struct panel_test *t = test->priv;
+	const char *actual = t->log;
+	unsigned int line = 1;
+	size_t elen, alen;
+
+	while (*expected || *actual) {
+		elen = strcspn(expected, "\n");
+		alen = strcspn(actual, "\n");
+		if (elen != alen || memcmp(expected, actual, elen)) {
+			KUNIT_FAIL(test, "line %u: expected \"%.*s\", got \"%.*s\"", line,
+				   (int)elen, expected, (int)alen, actual);
+			panel_test_dump(test);
+			return;
+		}
+		expected += elen + (expected[elen] == '\n');
+		actual += alen + (actual[alen] == '\n');
+		line++;
+	}
+}
+
+static unsigned int panel_test_count(struct kunit *test, const char *line)
+{
+	struct panel_test *t = test->priv;
+	const char *pos = t->log;
+	unsigned int count = 0;
+
+	while ((pos = strstr(pos, line))) {
+		pos += strlen(line);
+		count++;
+	}
+
+	return count;
+}
+
+/* The delays prepare asks for from power off, msleep() never sleeps less */
+static unsigned int panel_test_fixed_us(struct mipi_dsi_panel *dsi_panel)
+{
+	const struct mipi_dsi_panel_seq *seq = &dsi_panel->init_seq;
+	unsigned int ms = dsi_panel->power_on_delay + dsi_panel->reset_delay;
+	size_t pos = 0;
+	u8 len;
+
+	while (pos < seq->len) {
+		len = seq->data[pos++];
+		if (!len)
+			ms += get_unaligned_le16(&seq->data[pos]);
+		pos += len ? len : 2;
+	}
+
+	return ms * 1000;
+}
+
+static int panel_test_prepare(struct kunit *test)
+{
+	struct panel_test *t = test->priv;
+
+	panel_test_step(t, "prepare");
+
+	return drm_panel_prepare(&t->dsi_panel->panel);
+}
+
+static void panel_test_unprepare(struct kunit *test)
+{
+	struct panel_test *t = test->priv;
+
+	panel_test_step(t, "unprepare");
+	KUNIT_EXPECT_EQ(test, drm_panel_unprepare(&t->dsi_panel->panel), 0);
+}
+
+/* Power off right away instead of after the autosuspend delay */
+static void panel_test_suspend(struct kunit *test)
+{
+	struct panel_test *t = test->priv;
+
+	panel_test_step(t, "suspend");
+	KUNIT_EXPECT_EQ(test, pm_runtime_suspend(&t->dsi->dev), 0);
+}
+
+/* Golden streams, see panel-mipi-dsi-test-golden.S */
+extern const char panel_mipi_dsi_golden_wf40eswaa6mnn0[];
+extern const char panel_mipi_dsi_golden_wf70a8syahmngb[];
+extern const char panel_mipi_dsi_golden_ts070wsh02ce[];
+extern const char panel_mipi_dsi_golden_am4001280a3tzqw01h[];
+extern const char panel_mipi_dsi_golden_top055fhd01a[];
+
+static const struct {
+	const char *compatible;
+	const char *stream;
+} panel_test_goldens[] = {
+	{ "winstar,wf40eswaa6mnn0", panel_mipi_dsi_golden_wf40eswaa6mnn0 },
+	{ "winstar,wf70a8syahmngb", panel_mipi_dsi_golden_wf70a8syahmngb },
+	{ "tdo,ts070wsh02ce", panel_mipi_dsi_golden_ts070wsh02ce },
+	{ "ampire,am4001280a3tzqw01h", panel_mipi_dsi_golden_am4001280a3tzqw01h },
+	{ "wisecoco,top055fhd01a", panel_mipi_dsi_golden_top055fhd01a },
+};
+
+static const void *panel_test_gen_match(const void *prev, char *desc)
+{
+	const struct of_device_id *id = prev ? (const struct of_device_id *)prev + 1 :
+					       mipi_dsi_panel_of_match;
+
+	if (!id->compatible[0])
+		return NULL;
+	strscpy(desc, id->compatible, KUNIT_PARAM_DESC_SIZE);
+
+	return id;
+}
+
+/* Every built-in panel from probe to power off, with the default device tree */
+static void panel_test_bring_up(struct kunit *test)
+{
+	const struct of_device_id *id = test->param_value;
+	struct panel_test *t = test->priv;
+	struct mipi_dsi_panel_model model;
+	struct mipi_dsi_panel *dsi_panel;
+	const char *golden = NULL;
+	unsigned int fixed_us;
+	unsigned int i;
+	ktime_t start;
+	s64 us;
+
+	for (i = 0; i < ARRAY_SIZE(panel_test_goldens); i++)
+		if (!strcmp(panel_test_goldens[i].compatible, id->compatible))
+			golden = panel_test_goldens[i].stream;
+	KUNIT_ASSERT_NOT_NULL_MSG(test, golden, "no golden stream for %s", id->compatible);
+
+	dsi_panel = panel_test_add(test, id->data);
+
+	start = ktime_get();
+	KUNIT_ASSERT_EQ(test, panel_test_prepare(test), 0);
+	us = ktime_us_delta(ktime_get(), start);
+
+	mipi_dsi_panel_model(dsi_panel, &model);
+	fixed_us = panel_test_fixed_us(dsi_panel);
+	kunit_info(test, "%s: prepare took %lld us, modelled %u us (power-on %u, reset %u, %u commands in %u us, delays %u us)\n",
+		   id->compatible, us, model.total_us, model.power_on_us, model.reset_us,
+		   model.cmds, model.xfer_us, model.delay_us);
+	KUNIT_EXPECT_GE(test, us, (s64)fixed_us);
+
+	panel_test_step(t, "enable");
+	KUNIT_EXPECT_EQ(test, drm_panel_enable(&dsi_panel->panel), 0);
+	/* The brightness is sent by bl_work */
+	flush_delayed_work(&dsi_panel->bl_work);
+
+	panel_test_step(t, "disable");
+	KUNIT_EXPECT_EQ(test, drm_panel_disable(&dsi_panel->panel), 0);
+
+	panel_test_unprepare(test);
+	panel_test_suspend(test);
+
+	panel_test_expect_stream(test, golden);
+}
+
+/* A single failed write is repeated, the rest of the sequence is not affected */
+static void panel_test_retry(struct kunit *test)
+{
+	struct panel_test *t = test->priv;
+	struct mipi_dsi_panel *dsi_panel;
+
+	dsi_panel = panel_test_add(test, &ts070wsh02ce_desc);
+	t->fail_cmd = 0x80;
+	t->fail_writes = 1;
+
+	KUNIT_EXPECT_EQ(test, panel_test_prepare(test), 0);
+	KUNIT_EXPECT_EQ(test, panel_test_count(test, "15 hs 80 8b (-5)\n"), 1);
+	KUNIT_EXPECT_EQ(test, panel_test_count(test, "15 hs 80 8b\n"), 1);
+	KUNIT_EXPECT_EQ(test, dsi_panel->stats.retries, 1);
+	KUNIT_EXPECT_EQ(test, dsi_panel->stats.resets, 0);
+
+	panel_test_unprepare(test);
+	panel_test_suspend(test);
+}
+
+/* The sequence is run again once after a reset, then prepare gives up */
+static void panel_test_init_fails(struct kunit *test)
+{
+	struct panel_test *t = test->priv;
+	struct mipi_dsi_panel *dsi_panel;
+
+	dsi_panel = panel_test_add(test, &ts070wsh02ce_desc);
+	t->fail_cmd = 0x80;
+	t->fail_writes = UINT_MAX;
+
+	KUNIT_EXPECT_EQ(test, panel_test_prepare(test), -EIO);
+	KUNIT_EXPECT_EQ(test, dsi_panel->stats.resets, 1);
+	KUNIT_EXPECT_EQ(test, panel_test_count(test, "15 hs 80 8b (-5)\n"),
+			2 * (MIPI_DSI_PANEL_CMD_RETRIES + 1));
+	/* The rest of the sequence was still sent both times */
+	KUNIT_EXPECT_EQ(test, panel_test_count(test, "05 hs 29\n"), 2);
+	KUNIT_EXPECT_FALSE(test, dsi_panel->powered);
+	KUNIT_EXPECT_FALSE(test, dsi_panel->initialized);
+
+	panel_test_suspend(test);
+}
+
+/* Checks the registers only if the device tree sets verify-init */
+static void panel_test_verify(struct kunit *test)
+{
+	struct panel_test *t = test->priv;
+	struct mipi_dsi_panel *dsi_panel;
+
+	panel_test_set_prop(t, "verify-init", NULL, 0);
+	dsi_panel = panel_test_add(test, &top055fhd01a_desc);
+	t->regs[MIPI_DCS_GET_DISPLAY_BRIGHTNESS] = 0xff;
+
+	KUNIT_EXPECT_EQ(test, panel_test_prepare(test), 0);
+	KUNIT_EXPECT_EQ(test, panel_test_count(test, "06 hs 52\n"), 1);
+	KUNIT_EXPECT_EQ(test, panel_test_count(test, "06 hs 54\n"), 1);
+	KUNIT_EXPECT_EQ(test, panel_test_count(test, "06 hs 0a\n"), 1);
+	KUNIT_EXPECT_EQ(test, dsi_panel->stats.verify_errors, 0);
+
+	panel_test_unprepare(test);
+	panel_test_suspend(test);
+}
+
+static void panel_test_verify_not_set(struct kunit *test)
+{
+	panel_test_add(test, &top055fhd01a_desc);
+
+	KUNIT_EXPECT_EQ(test, panel_test_prepare(test), 0);
+	KUNIT_EXPECT_EQ(test, panel_test_count(test, "06 "), 0);
+
+	panel_test_unprepare(test);
+	panel_test_suspend(test);
+}
+
+/* A wrong value resets and initializes the panel once more, then prepare fails */
+static void panel_test_verify_mismatch(struct kunit *test)
+{
+	struct panel_test *t = test->priv;
+	struct mipi_dsi_panel *dsi_panel;
+
+	panel_test_set_prop(t, "verify-init", NULL, 0);
+	dsi_panel = panel_test_add(test, &top055fhd01a_desc);
+	t->regs[MIPI_DCS_GET_DISPLAY_BRIGHTNESS] = 0x80;
+
+	KUNIT_EXPECT_EQ(test, panel_test_prepare(test), -EIO);
+	KUNIT_EXPECT_EQ(test, dsi_panel->stats.verify_errors, 2);
+	KUNIT_EXPECT_EQ(test, dsi_panel->stats.resets, 1);
+
+	panel_test_suspend(test);
+}
+
+/* A host that can't read is no reason to reset the panel */
+static void panel_test_verify_unreadable(struct kunit *test)
+{
+	struct panel_test *t = test->priv;
+	struct mipi_dsi_panel *dsi_panel;
+
+	panel_test_set_prop(t, "verify-init", NULL, 0);
+	dsi_panel = panel_test_add(test, &top055fhd01a_desc);
+	t->read_ret = -EOPNOTSUPP;
+
+	KUNIT_EXPECT_EQ(test, panel_test_prepare(test), 0);
+	KUNIT_EXPECT_EQ(test, panel_test_count(test, "06 hs "), 1);
+	KUNIT_EXPECT_EQ(test, dsi_panel->stats.verify_errors, 0);
+	KUNIT_EXPECT_EQ(test, dsi_panel->stats.resets, 0);
+
+	panel_test_unprepare(test);
+	panel_test_suspend(test);
+}
+
+static const u8 panel_test_init_seq[] = {
+	MIPI_DSI_SEQ_CMD(0xB0, 0x01),
+	MIPI_DSI_SEQ_CMD(MIPI_DCS_EXIT_SLEEP_MODE),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(MIPI_DCS_SET_DISPLAY_ON),
+};
+
+/* 800x480 at 60 Hz, two slices wide for DSC */
+static const struct drm_display_mode panel_test_mode = {
+	.clock = 29232,
+	.hdisplay = 800,
+	.hsync_start = 800 + 40,
+	.hsync_end = 800 + 40 + 48,
+	.htotal = 800 + 40 + 48 + 40,
+	.vdisplay = 480,
+	.vsync_start = 480 + 13,
+	.vsync_end = 480 + 13 + 3,
+	.vtotal = 480 + 13 + 3 + 29,
+	.type = DRM_MODE_TYPE_DRIVER | DRM_MODE_TYPE_PREFERRED,
+};
+
+/* 640x480 at 60 Hz */
+static const struct drm_display_mode panel_test_vga_mode = {
+	.clock = 25200,
+	.hdisplay = 640,
+	.hsync_start = 640 + 16,
+	.hsync_end = 640 + 16 + 96,
+	.htotal = 640 + 16 + 96 + 48,
+	.vdisplay = 480,
+	.vsync_start = 480 + 10,
+	.vsync_end = 480 + 10 + 2,
+	.vtotal = 480 + 10 + 2 + 33,
+	.type = DRM_MODE_TYPE_DRIVER | DRM_MODE_TYPE_PREFERRED,
+};
+
+static const struct mipi_dsi_panel_panel_desc panel_test_cmd_mode_desc = {
+	.mode = &panel_test_vga_mode,
+	.lanes = 2,
+	.flags = MIPI_DSI_MODE_VIDEO | MIPI_DSI_MODE_VIDEO_BURST,
+	.format = MIPI_DSI_FMT_RGB888,
+	.init_seq = MIPI_DSI_PANEL_SEQ(panel_test_init_seq),
+	.cmd_mode = true,
+};
+
+/* Tearing effect on and the full 640x480 screen, after the init sequence and after sleep out */
+static const char panel_test_cmd_mode_stream[] =
+	"# prepare\n"
+	"reset 0\n"
+	"reset 1\n"
+	"15 hs b0 01\n"
+	"05 hs 11\n"
+	"05 hs 29\n"
+	"15 hs 35 00\n"
+	"39 hs 2a 00 00 02 7f\n"
+	"39 hs 2b 00 00 01 df\n"
+	"# unprepare\n"
+	"05 hs 10\n"
+	"# prepare\n"
+	"05 hs 11\n"
+	"05 hs 29\n"
+	"15 hs 35 00\n"
+	"39 hs 2a 00 00 02 7f\n"
+	"39 hs 2b 00 00 01 df\n"
+	"# unprepare\n"
+	"05 hs 10\n"
+	"# suspend\n"
+	"reset 0\n";
+
+static void panel_test_cmd_mode(struct kunit *test)
+{
+	struct panel_test *t = test->priv;
+	unsigned int i;
+
+	panel_test_add(test, &panel_test_cmd_mode_desc);
+	KUNIT_EXPECT_FALSE(test, t->dsi->mode_flags & MIPI_DSI_MODE_VIDEO);
+	KUNIT_EXPECT_FALSE(test, t->dsi->mode_flags & MIPI_DSI_MODE_VIDEO_BURST);
+
+	for (i = 0; i < 2; i++) {
+		KUNIT_ASSERT_EQ(test, panel_test_prepare(test), 0);
+		panel_test_unprepare(test);
+	}
+	panel_test_suspend(test);
+
+	panel_test_expect_stream(test, panel_test_cmd_mode_stream);
+}
+
+#if MIPI_DSI_PANEL_DSC
+/* Two slices per line, 8 bpc compressed to 8 bpp, one of the VESA reference tables */
+static const struct mipi_dsi_panel_dsc panel_test_dsc = {
+	.slice_width = 400,
+	.slice_height = 16,
+	.bits_per_component = 8,
+	.bits_per_pixel = 8,
+};
+
+static const struct mipi_dsi_panel_panel_desc panel_test_dsc_desc = {
+	.mode = &panel_test_mode,
+	.lanes = 2,
+	.flags = MIPI_DSI_MODE_VIDEO | MIPI_DSI_MODE_VIDEO_BURST,
+	.format = MIPI_DSI_FMT_RGB888,
+	.init_seq = MIPI_DSI_PANEL_SEQ(panel_test_init_seq),
+	.dsc = &panel_test_dsc,
+};
+
+static struct mipi_dsi_panel *panel_test_add_dsc(struct kunit *test)
+{
+	struct panel_test *t = test->priv;
+
+	panel_test_set_prop(t, "enable-dsc", NULL, 0);
+
+	return panel_test_add(test, &panel_test_dsc_desc);
+}
+
+static void panel_test_dsc_pps(struct kunit *test)
+{
+	struct drm_dsc_picture_parameter_set pps;
+	struct mipi_dsi_panel *dsi_panel;
+	const struct drm_dsc_config *dsc;
+
+	dsi_panel = panel_test_add_dsc(test);
+	KUNIT_ASSERT_PTR_EQ(test, dsi_panel->dsi->dsc, &dsi_panel->dsc_config);
+	dsc = dsi_panel->dsi->dsc;
+
+	KUNIT_EXPECT_EQ(test, dsc->pic_width, 800);
+	KUNIT_EXPECT_EQ(test, dsc->pic_height, 480);
+	KUNIT_EXPECT_EQ(test, dsc->slice_count, 2);
+	KUNIT_EXPECT_EQ(test, dsc->bits_per_pixel, 8 << 4);
+	KUNIT_EXPECT_EQ(test, dsc->line_buf_depth, 9);
+
+	drm_dsc_pps_payload_pack(&pps, dsc);
+	KUNIT_EXPECT_EQ(test, pps.dsc_version, 0x11);
+	/* 8 bpc, line buffer depth 9 */
+	KUNIT_EXPECT_EQ(test, pps.pps_3, 0x89);
+	KUNIT_EXPECT_EQ(test, pps.bits_per_pixel_low, 0x80);
+	KUNIT_EXPECT_EQ(test, be16_to_cpu(pps.pic_width), 800);
+	KUNIT_EXPECT_EQ(test, be16_to_cpu(pps.pic_height), 480);
+	KUNIT_EXPECT_EQ(test, be16_to_cpu(pps.slice_width), 400);
+	KUNIT_EXPECT_EQ(test, be16_to_cpu(pps.slice_height), 16);
+	KUNIT_EXPECT_EQ(test, be16_to_cpu(pps.rc_model_size), DSC_RC_MODEL_SIZE_CONST);
+}
+
+/* The PPS and compression mode reach the panel before every exit sleep mode */
+static void panel_test_dsc_stream(struct kunit *test)
+{
+	struct drm_dsc_picture_parameter_set pps;
+	struct mipi_dsi_panel *dsi_panel;
+	char pps_line[3 * PANEL_TEST_LOG_BYTES + 16];
+	char *expected;
+	size_t len = 0;
+	unsigned int i;
+
+	dsi_panel = panel_test_add_dsc(test);
+	KUNIT_ASSERT_NOT_NULL(test, dsi_panel->dsi->dsc);
+	for (i = 0; i < 2; i++) {
+		KUNIT_ASSERT_EQ(test, panel_test_prepare(test), 0);
+		panel_test_unprepare(test);
+	}
+	panel_test_suspend(test);
+
+	drm_dsc_pps_payload_pack(&pps, dsi_panel->dsi->dsc);
+	scnprintf(pps_line, sizeof(pps_line), "0a hs %*ph ...\n", PANEL_TEST_LOG_BYTES, &pps);
+
+	expected = kunit_kzalloc(test, PANEL_TEST_LOG_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, expected);
+	len += scnprintf(expected + len, PANEL_TEST_LOG_SIZE - len,
+			 "# prepare\nreset 0\nreset 1\n15 hs b0 01\n%s07 hs 01 00\n"
+			 "05 hs 11\n05 hs 29\n# unprepare\n05 hs 10\n", pps_line);
+	/* Sleep mode turned compression off, the PPS is sent again */
+	len += scnprintf(expected + len, PANEL_TEST_LOG_SIZE - len,
+			 "# prepare\n%s07 hs 01 00\n05 hs 11\n05 hs 29\n"
+			 "# unprepare\n05 hs 10\n# suspend\nreset 0\n", pps_line);
+	panel_test_expect_stream(test, expected);
+	KUNIT_EXPECT_EQ(test, panel_test_count(test, "\n0a hs "), 2);
+}
+
+/* A host without DSC gets the uncompressed stream */
+static void panel_test_dsc_refused(struct kunit *test)
+{
+	struct panel_test *t = test->priv;
+	struct mipi_dsi_panel *dsi_panel;
+
+	t->refuse_dsc = true;
+	dsi_panel = panel_test_add_dsc(test);
+	KUNIT_EXPECT_NULL(test, dsi_panel->dsi->dsc);
+
+	KUNIT_ASSERT_EQ(test, panel_test_prepare(test), 0);
+	panel_test_unprepare(test);
+	panel_test_suspend(test);
+
+	KUNIT_EXPECT_EQ(test, panel_test_count(test, "\n0a "), 0);
+	KUNIT_EXPECT_EQ(test, panel_test_count(test, "\n07 "), 0);
+	KUNIT_EXPECT_EQ(test, panel_test_count(test, "05 hs 11\n"), 1);
+}
+#endif
+
+static int panel_test_init(struct kunit *test)
+{
+	struct panel_test *t;
+	int ret;
+
+	t = kunit_kzalloc(test, sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return -ENOMEM;
+	t->log = kunit_kzalloc(test, PANEL_TEST_LOG_SIZE, GFP_KERNEL);
+	if (!t->log)
+		return -ENOMEM;
+	spin_lock_init(&t->lock);
+	of_node_init(&t->np);
+	t->np.full_name = "panel";
+	test->priv = t;
+
+	/* Undone by panel_test_exit(), which also runs if this fails */
+	t->dev = root_device_register(PANEL_TEST_NAME);
+	if (IS_ERR(t->dev)) {
+		ret = PTR_ERR(t->dev);
+		t->dev = NULL;
+		return ret;
+	}
+
+	t->host.dev = t->dev;
+	t->host.ops = &panel_test_host_ops;
+	ret = mipi_dsi_host_register(&t->host);
+	if (ret)
+		return ret;
+	t->host_added = true;
+
+	/* No parent, the host removes every child of t->dev as a DSI device */
+	t->gpio.label = PANEL_TEST_NAME;
+	t->gpio.owner = THIS_MODULE;
+	t->gpio.base = -1;
+	t->gpio.ngpio = 1;
+	t->gpio.set = panel_test_gpio_set;
+	t->gpio.direction_output = panel_test_gpio_direction_output;
+	t->gpio.get_direction = panel_test_gpio_get_direction;
+	ret = gpiochip_add_data(&t->gpio, t);
+	if (ret)
+		return ret;
+	t->gpio_added = true;
+
+	return 0;
+}
+
+static void panel_test_exit(struct kunit *test)
+{
+	struct panel_test *t = test->priv;
+
+	if (!t)
+		return;
+	if (!IS_ERR_OR_NULL(t->dsi))
+		mipi_dsi_device_unregister(t->dsi);
+	if (t->gpio_added)
+		gpiochip_remove(&t->gpio);
+	if (t->host_added)
+		mipi_dsi_host_unregister(&t->host);
+	if (t->dev)
+		root_device_unregister(t->dev);
+}
+
+static int panel_test_suite_init(struct kunit_suite *suite)
+{
+	int ret;
+
+	mipi_dsi_panel_debugfs_root = debugfs_create_dir(PANEL_TEST_NAME, NULL);
+	gpiod_add_lookup_table(&panel_test_gpios);
+
+	ret = mipi_dsi_driver_register(&panel_test_driver);
+	if (ret) {
+		gpiod_remove_lookup_table(&panel_test_gpios);
+		debugfs_remove_recursive(mipi_dsi_panel_debugfs_root);
+	}
+
+	return ret;
+}
+
+static void panel_test_suite_exit(struct kunit_suite *suite)
+{
+	mipi_dsi_driver_unregister(&panel_test_driver);
+	gpiod_remove_lookup_table(&panel_test_gpios);
+	debugfs_remove_recursive(mipi_dsi_panel_debugfs_root);
+}
+
+static struct kunit_case panel_test_cases[] = {
+	KUNIT_CASE_PARAM(panel_test_bring_up, panel_test_gen_match),
+	KUNIT_CASE(panel_test_retry),
+	KUNIT_CASE(panel_test_init_fails),
+	KUNIT_CASE(panel_test_verify),
+	KUNIT_CASE(panel_test_verify_not_set),
+	KUNIT_CASE(panel_test_verify_mismatch),
+	KUNIT_CASE(panel_test_verify_unreadable),
+	KUNIT_CASE(panel_test_cmd_mode),
+#if MIPI_DSI_PANEL_DSC
+	KUNIT_CASE(panel_test_dsc_pps),
+	KUNIT_CASE(panel_test_dsc_stream),
+	KUNIT_CASE(panel_test_dsc_refused),
+#endif
+	{ }
+};
+
+static struct kunit_suite panel_test_suite = {
+	.name = "panel-mipi-dsi",
+	.init = panel_test_init,
+	.exit = panel_test_exit,
+	.suite_init = panel_test_suite_init,
+	.suite_exit = panel_test_suite_exit,
+	.test_cases = panel_test_cases,
+};
+kunit_test_suite(panel_test_suite);
+
+MODULE_DESCRIPTION("KUnit tests for panel-mipi-dsi");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Tracepoints for panel-mipi-dsi, enable them with
+ * echo 1 > /sys/kernel/tracing/events/panel_mipi_dsi/enable
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM panel_mipi_dsi
+
+#if !defined(_PANEL_MIPI_DSI_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _PANEL_MIPI_DSI_TRACE_H
+
+#include <linux/device.h>
+#include <linux/tracepoint.h>
+
+/* One bring-up phase (regulators, reset, init-seq, enable) has finished */
+TRACE_EVENT(panel_mipi_dsi_phase,
+	TP_PROTO(struct device *dev, const char *phase, u64 duration_us, int ret),
+	TP_ARGS(dev, phase, duration_us, ret),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__string(phase, phase)
+		__field(u64, duration_us)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__assign_str(phase, phase);
+		__entry->duration_us = duration_us;
+		__entry->ret = ret;
+	),
+
+	TP_printk("%s: %s took %llu us, ret=%d", __get_str(dev), __get_str(phase),
+		  __entry->duration_us, __entry->ret)
+);
+
+/* One DCS write of an init sequence, cmd is the first byte, attempt 0 is no retry */
+TRACE_EVENT(panel_mipi_dsi_cmd,
+	TP_PROTO(struct device *dev, u8 cmd, size_t len, unsigned int attempt, int ret),
+	TP_ARGS(dev, cmd, len, attempt, ret),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(u8, cmd)
+		__field(size_t, len)
+		__field(unsigned int, attempt)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->cmd = cmd;
+		__entry->len = len;
+		__entry->attempt = attempt;
+		__entry->ret = ret;
+	),
+
+	TP_printk("%s: cmd=0x%02x len=%zu attempt=%u ret=%d", __get_str(dev), __entry->cmd,
+		  __entry->len, __entry->attempt, __entry->ret)
+);
+
+/* A burst of init sequence commands sent back to back, between two delays */
+TRACE_EVENT(panel_mipi_dsi_burst,
+	TP_PROTO(struct device *dev, unsigned int cmds, size_t bytes, bool lp,
+		 u64 duration_us, int ret),
+	TP_ARGS(dev, cmds, bytes, lp, duration_us, ret),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(unsigned int, cmds)
+		__field(size_t, bytes)
+		__field(bool, lp)
+		__field(u64, duration_us)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->cmds = cmds;
+		__entry->bytes = bytes;
+		__entry->lp = lp;
+		__entry->duration_us = duration_us;
+		__entry->ret = ret;
+	),
+
+	TP_printk("%s: %u cmds, %zu bytes in %s mode took %llu us, ret=%d",
+		  __get_str(dev), __entry->cmds, __entry->bytes,
+		  __entry->lp ? "lp" : "hs", __entry->duration_us, __entry->ret)
+);
+
+#endif /* _PANEL_MIPI_DSI_TRACE_H */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE panel-mipi-dsi-trace
+#include <trace/define_trace.h>
@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-2.0+
 #define DEBUG
+#include <drm/display/drm_dsc.h>
 #include <drm/drm_mipi_dsi.h>
 #include <drm/drm_modes.h>
 #include <drm/drm_panel.h>
@@ -7,14 +8,138 @@
 #include <drm/drm_crtc.h>
 
 #include <linux/backlight.h>
+#include <linux/completion.h>
+#include <linux/crc32.h>
+#include <linux/debugfs.h>
+#include <linux/firmware.h>
 #include <linux/gpio/consumer.h>
 #include <linux/delay.h>
+#include <linux/iopoll.h>
 #include <linux/module.h>
 #include <linux/of_device.h>
+#include <linux/pm_runtime.h>
 #include <linux/regulator/consumer.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
+#include <linux/workqueue.h>
+
+#include <asm/unaligned.h>
 
 #include <video/mipi_display.h>
 
+#define CREATE_TRACE_POINTS
+#include "panel-mipi-dsi-trace.h"
+
+/* The rate control helpers for DSC 1.1 came with 6.4, enable-dsc is ignored before */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0) && IS_REACHABLE(CONFIG_DRM_DISPLAY_DSC_HELPER)
+#include <drm/display/drm_dsc_helper.h>
+#define MIPI_DSI_PANEL_DSC	1
+#else
+#define MIPI_DSI_PANEL_DSC	0
+#endif
+
+struct mipi_dsi_panel_seq {
+	const u8 *data;
+	size_t len;
+};
+
+#define MIPI_DSI_PANEL_SEQ(seq) { .data = seq, .len = sizeof(seq) }
+
+/*
+ * How the init sequence is transmitted, applied once per burst of commands.
+ * The mode flags of the device are restored afterwards, under shadow_lock.
+ * Bursts are only sent while the panel is prepared: by prepare, enable, the
+ * health check and the brightness work.
+ */
+enum mipi_dsi_panel_xfer {
+	MIPI_DSI_PANEL_XFER_DEFAULT,		/* as given by the flags of the panel */
+	MIPI_DSI_PANEL_XFER_LP,			/* low power mode */
+	MIPI_DSI_PANEL_XFER_HS,			/* high speed mode */
+	MIPI_DSI_PANEL_XFER_LP_UNTIL_SLEEP_OUT,	/* high speed after exit sleep mode */
+};
+
+/*
+ * Minimum delays in us used instead of the fixed ones if fast-bring-up is set
+ * in the device tree, 0 keeps the fixed delay. Delays of the init sequence up
+ * to MIPI_DSI_PANEL_SHORT_DELAY ms are cut down to step. The delays after
+ * exit sleep mode and set display on are replaced by polling the power mode
+ * if the panel supports reading it, the fixed delay is the timeout. The
+ * sleep out bit is set as soon as the command was received, it is only
+ * polled after the minimum time the panel needs to leave sleep mode.
+ */
+struct mipi_dsi_panel_fast_delays {
+	unsigned int power_on;
+	unsigned int reset;
+	unsigned int sleep_out;	/* before polling, MIPI_DSI_PANEL_SLEEP_OUT_DELAY if 0 */
+	unsigned int step;
+	bool poll_power_mode;
+};
+
+#define MIPI_DSI_PANEL_SHORT_DELAY	10
+#define MIPI_DSI_PANEL_POLL_US		1000
+
+/*
+ * A register read back after the init sequence, the panel is reset and
+ * initialized again if (value & mask) != val. A mask of 0 only logs the value.
+ */
+struct mipi_dsi_panel_reg_check {
+	u8 reg;
+	u8 mask;
+	u8 val;
+};
+
+/* A failed write is repeated, a failed init sequence redone after a reset */
+#define MIPI_DSI_PANEL_CMD_RETRIES	3
+#define MIPI_DSI_PANEL_INIT_RESETS	1
+
+/*
+ * Shadow of the registers written to a panel with a page command, a write
+ * that would not change the panel is skipped. Registers are tracked per page,
+ * the page is identified by the parameters of the last page command, a page
+ * of length 0 is the one selected by a reset. Commands without parameters are
+ * actions and always sent. The shadow is dropped on reset and power off.
+ */
+#define MIPI_DSI_PANEL_SHADOW_PAGE_LEN	7
+#define MIPI_DSI_PANEL_SHADOW_REG_LEN	32
+/* Room for registers written through debugfs that the init sequence does not set */
+#define MIPI_DSI_PANEL_SHADOW_EXTRA	16
+
+struct mipi_dsi_panel_shadow_page {
+	u8 len;
+	u8 sel[MIPI_DSI_PANEL_SHADOW_PAGE_LEN];
+};
+
+struct mipi_dsi_panel_shadow_reg {
+	struct mipi_dsi_panel_shadow_page page;
+	u8 len;
+	u8 data[MIPI_DSI_PANEL_SHADOW_REG_LEN];	/* register followed by its value */
+};
+
+struct mipi_dsi_panel_shadow {
+	/* NULL if the panel has no page command */
+	struct mipi_dsi_panel_shadow_reg *regs;
+	unsigned int num_regs;
+	unsigned int max_regs;
+	struct mipi_dsi_panel_shadow_page page;
+	bool page_known;
+	/* Commands sent and skipped by the current sequence, also without regs */
+	unsigned int sent;
+	unsigned int skipped;
+};
+
+/*
+ * Display Stream Compression of the pixel data on the link. The slices are
+ * what the decoder of the panel expects, the rate control parameters and the
+ * PPS are calculated from them and the mode.
+ */
+struct mipi_dsi_panel_dsc {
+	u16 slice_width;
+	u16 slice_height;
+	u8 bits_per_component;	/* 0 for 8 */
+	u8 bits_per_pixel;	/* after compression */
+};
+
 struct mipi_dsi_panel_panel_desc {
 	const struct drm_display_mode *mode;
 	unsigned int lanes;
@@ -24,333 +149,1927 @@ struct mipi_dsi_panel_panel_desc {
 	unsigned int num_supplies;
 	unsigned int panel_sleep_delay;
 	bool panel_has_backlight;
+	/* Highest rate per lane in kbps the panel and its wiring take, 0 if unknown */
+	unsigned int max_lane_rate;
+	/* Registers read for snapshots, the DCS status registers if NULL */
+	const u8 *snapshot_regs;
+	unsigned int num_snapshot_regs;
+
+	struct mipi_dsi_panel_seq init_seq;
+	enum mipi_dsi_panel_xfer init_xfer;
+	/* The init sequence puts the panel into command mode */
+	bool cmd_mode;
+	/* Read back after the init sequence if the device tree sets verify-init */
+	const struct mipi_dsi_panel_reg_check *verify;
+	unsigned int num_verify;
+	const struct mipi_dsi_panel_fast_delays *fast;
+	/* Command selecting a register page, 0 if there is none and no shadow */
+	u8 page_cmd;
+	/* Selects the user command set, sent before brightness writes if page_cmd is set */
+	struct mipi_dsi_panel_seq user_page;
+	/* Read by the health check, the power mode if NULL */
+	const struct mipi_dsi_panel_reg_check *esd_check;
+	/* DSC the panel decodes, only used if the device tree sets enable-dsc */
+	const struct mipi_dsi_panel_dsc *dsc;
+};
+
+enum mipi_dsi_panel_phase {
+	MIPI_DSI_PANEL_PHASE_REGULATORS,
+	MIPI_DSI_PANEL_PHASE_RESET,
+	MIPI_DSI_PANEL_PHASE_INIT_SEQ,
+	MIPI_DSI_PANEL_PHASE_ENABLE,
+	MIPI_DSI_PANEL_PHASE_SLEEP_OUT,
+	MIPI_DSI_PANEL_PHASE_ESD_RECOVERY,
+	MIPI_DSI_PANEL_NUM_PHASES,
+};
+
+static const char * const mipi_dsi_panel_phase_names[] = {
+	[MIPI_DSI_PANEL_PHASE_REGULATORS] = "regulators",
+	[MIPI_DSI_PANEL_PHASE_RESET] = "reset",
+	[MIPI_DSI_PANEL_PHASE_INIT_SEQ] = "init-seq",
+	[MIPI_DSI_PANEL_PHASE_ENABLE] = "enable",
+	[MIPI_DSI_PANEL_PHASE_SLEEP_OUT] = "sleep-out",
+	[MIPI_DSI_PANEL_PHASE_ESD_RECOVERY] = "esd-recovery",
+};
+
+struct mipi_dsi_panel_phase_stats {
+	u64 count;
+	u64 errors;
+	u64 last_us;
+	u64 max_us;
+	u64 total_us;
+};
+
+/*
+ * Recovery after a failed health check, cheapest first: leave sleep mode and
+ * turn the display on again, then write all registers of the init sequence
+ * again. The panel is enabled and the host streams to it, so it is never
+ * reset here, a panel that does not recover is tried again at the next check.
+ */
+enum mipi_dsi_panel_esd_step {
+	MIPI_DSI_PANEL_ESD_WAKE,
+	MIPI_DSI_PANEL_ESD_REPLAY,
+	MIPI_DSI_PANEL_ESD_STEPS,
+};
+
+static const char * const mipi_dsi_panel_esd_step_names[] = {
+	[MIPI_DSI_PANEL_ESD_WAKE] = "wake",
+	[MIPI_DSI_PANEL_ESD_REPLAY] = "replay",
+};
+
+/* A check that finds the panel busy is retried this much later */
+#define MIPI_DSI_PANEL_ESD_RETRY_MS	50
+
+/* Shown in debugfs, protected by stats_lock */
+struct mipi_dsi_panel_stats {
+	struct mipi_dsi_panel_phase_stats phases[MIPI_DSI_PANEL_NUM_PHASES];
+	u64 bursts;
+	u64 writes;
+	u64 write_errors;
+	u64 retries;
+	u64 verify_errors;
+	u64 resets;
+	/* Brightness requests and the writes left after coalescing them */
+	u64 bl_requests;
+	u64 bl_writes;
+	/* Writes skipped because the shadow already held the value */
+	u64 skipped;
+	unsigned int last_init_sent;
+	unsigned int last_init_skipped;
+	/* Health checks, the failed ones and which recovery step fixed them */
+	u64 esd_checks;
+	u64 esd_faults;
+	u64 esd_recovered[MIPI_DSI_PANEL_ESD_STEPS];
+	u64 esd_unrecovered;
+	/* Failed init sequence writes by DCS command, the first byte sent */
+	u32 cmd_errors[256];
+};
+
+/*
+ * A transfer recorded through debugfs, only the first bytes are kept. The
+ * capture is a ring of the last MIPI_DSI_PANEL_CAPTURE_SIZE transfers.
+ */
+#define MIPI_DSI_PANEL_CAPTURE_SIZE	256
+#define MIPI_DSI_PANEL_CAPTURE_BYTES	8
+
+struct mipi_dsi_panel_capture {
+	ktime_t time;
+	u8 data[MIPI_DSI_PANEL_CAPTURE_BYTES];
+	u8 len;
+	bool read;
+	s16 ret;
+};
 
-	void (*init_sequence)(struct mipi_dsi_device *dev);
+/*
+ * Values of the snapshot registers of a panel read in one pass through debugfs.
+ * The first snapshot is the baseline the later ones are compared to, once
+ * MIPI_DSI_PANEL_SNAPSHOTS are taken the oldest after the baseline is dropped.
+ */
+#define MIPI_DSI_PANEL_SNAPSHOTS	8
+#define MIPI_DSI_PANEL_SNAPSHOT_REGS	16
+
+struct mipi_dsi_panel_snapshot {
+	ktime_t time;
+	u16 failed;	/* one bit per register that could not be read */
+	u8 val[MIPI_DSI_PANEL_SNAPSHOT_REGS];
 };
 
+/*
+ * Cost of a command in the bring-up model: host driver and LP-11 to HS
+ * overhead per packet, and the transmission of one byte in low power mode.
+ * High speed bytes are free compared to that.
+ */
+#define MIPI_DSI_PANEL_MODEL_CMD_US	20
+#define MIPI_DSI_PANEL_MODEL_LP_BYTE_NS	1000
+
+struct mipi_dsi_panel_model {
+	unsigned int power_on_us;
+	unsigned int reset_us;
+	unsigned int cmds;
+	size_t bytes;
+	unsigned int xfer_us;
+	unsigned int delay_us;
+	unsigned int total_us;
+};
+
+/* Delays in ms during prepare if neither the descriptor nor a firmware sets them */
+#define MIPI_DSI_PANEL_POWER_ON_DELAY	20
+#define MIPI_DSI_PANEL_RESET_DELAY	150
+
+/* Refresh rates a mode may have, fw-compiler uses the same range */
+#define MIPI_DSI_PANEL_MIN_VREFRESH	10
+#define MIPI_DSI_PANEL_MAX_VREFRESH	240
+/* Delay in ms after leaving sleep mode if the panel was not powered off */
+#define MIPI_DSI_PANEL_SLEEP_OUT_DELAY	120
+/* The panel is powered off if it stays unprepared for this long, in ms */
+#define MIPI_DSI_PANEL_AUTOSUSPEND_DELAY	5000
+
 struct mipi_dsi_panel {
 	struct drm_panel panel;
 	struct mipi_dsi_device *dsi;
 	const struct mipi_dsi_panel_panel_desc *desc;
 
+	/* Taken from desc, or from the firmware or the panel node */
+	const struct drm_display_mode *mode;
+	struct mipi_dsi_panel_seq init_seq;
+	enum mipi_dsi_panel_xfer init_xfer;
+	unsigned int power_on_delay;
+	unsigned int reset_delay;
+	/* Only for the built-in init sequence and if verify-init is set */
+	const struct mipi_dsi_panel_reg_check *verify;
+	unsigned int num_verify;
+	/* NULL unless fast-bring-up is set */
+	const struct mipi_dsi_panel_fast_delays *fast;
+	/*
+	 * dsi->dsc points to dsc_config while compression is used, which is
+	 * calculated for the mode. Only set at probe.
+	 */
+	struct mipi_dsi_panel_dsc dsc;
+	struct drm_dsc_config dsc_config;
+
 	struct backlight_device *backlight;
 	struct regulator_bulk_data *supplies;
 	struct gpio_desc *reset;
 	unsigned int sleep_delay;
 	struct backlight_properties bl_props;
+	/*
+	 * Brightness requested last and the one the panel has, -1 if unknown.
+	 * bl_work sends it, bl_applied is protected by shadow_lock.
+	 */
+	u8 brightness;
+	int bl_applied;
+	ktime_t bl_sent;
+	struct delayed_work bl_work;
 	bool prepared;
 	bool wait_until_enabled;
+
+	/*
+	 * Health check every esd_interval ms while the panel is enabled, 0 if
+	 * esd-check-interval-ms is not set. The timer is deferrable, an idle
+	 * system is not woken up just for the check.
+	 */
+	unsigned int esd_interval;
+	struct delayed_work esd_work;
+
+	/*
+	 * With async-init probe queues power_work, which switches the supplies
+	 * on and resets the panel. The first prepare waits for it and takes
+	 * over its runtime PM reference, the init sequence is always sent by
+	 * prepare. Cleared once prepare took over.
+	 */
+	bool async_init;
+	struct work_struct power_work;
+	struct completion power_done;
+	int power_ret;
+	/* prepare holds a runtime PM reference, the supplies are on */
+	bool powered;
+	/* The panel is powered and still holds the state of the init sequence */
+	bool initialized;
+
+	/*
+	 * The init sequence puts the panel into command mode. The host then only
+	 * sends the frames it is given, always to the full screen, and can pace
+	 * them with the tearing effect output of the panel.
+	 */
+	bool cmd_mode;
+
+	/* Held while commands are sent through the shadow, the page must not change */
+	struct mutex shadow_lock;
+	struct mipi_dsi_panel_shadow shadow;
+
+	struct mutex stats_lock;
+	struct mipi_dsi_panel_stats stats;
+	struct dentry *debugfs;
+
+	/* Transfers recorded while capturing is set, protected by stats_lock */
+	struct mipi_dsi_panel_capture *capture;
+	unsigned int capture_count;
+	ktime_t capture_start;
+	bool capturing;
+
+	/* Register snapshots taken through debugfs, protected by stats_lock */
+	const u8 *snapshot_regs;
+	unsigned int num_snapshot_regs;
+	struct mipi_dsi_panel_snapshot snapshots[MIPI_DSI_PANEL_SNAPSHOTS];
+	unsigned int num_snapshots;
 };
 
-static inline struct mipi_dsi_panel *panel_to_dsi_panel(struct drm_panel *panel)
+static struct dentry *mipi_dsi_panel_debugfs_root;
+
+static inline struct mipi_dsi_panel *panel_to_dsi_panel(struct drm_panel *panel)
+{
+	return container_of(panel, struct mipi_dsi_panel, panel);
+}
+
+/*
+ * Init sequences are compact byte tables interpreted by
+ * mipi_dsi_panel_run_seq(). Each step starts with a length byte:
+ * - 1..255: that many bytes follow and are sent with one DCS write
+ * - 0: a delay, the time in ms follows as 16 bit little endian value
+ * The commands between two delays are sent as one burst, a burst also ends
+ * after exit sleep mode.
+ */
+#define MIPI_DSI_SEQ_CMD(seq...)	(u8)sizeof((u8[]){ seq }), seq
+#define MIPI_DSI_SEQ_DELAY(ms)		0, (ms) & 0xff, ((ms) >> 8) & 0xff
+
+static void mipi_dsi_panel_phase_done(struct mipi_dsi_panel *dsi_panel,
+				      enum mipi_dsi_panel_phase phase,
+				      ktime_t start, int ret)
+{
+	struct mipi_dsi_panel_phase_stats *stats = &dsi_panel->stats.phases[phase];
+	u64 us = ktime_us_delta(ktime_get(), start);
+
+	trace_panel_mipi_dsi_phase(&dsi_panel->dsi->dev, mipi_dsi_panel_phase_names[phase],
+				   us, ret);
+
+	mutex_lock(&dsi_panel->stats_lock);
+	stats->count++;
+	if (ret)
+		stats->errors++;
+	stats->last_us = us;
+	stats->max_us = max(stats->max_us, us);
+	stats->total_us += us;
+	mutex_unlock(&dsi_panel->stats_lock);
+}
+
+static void mipi_dsi_panel_cmd_failed(struct mipi_dsi_panel *dsi_panel, u8 cmd,
+				      unsigned int failures)
+{
+	mutex_lock(&dsi_panel->stats_lock);
+	dsi_panel->stats.write_errors += failures;
+	dsi_panel->stats.cmd_errors[cmd] += failures;
+	mutex_unlock(&dsi_panel->stats_lock);
+}
+
+static void mipi_dsi_panel_stats_inc(struct mipi_dsi_panel *dsi_panel, u64 *counter)
+{
+	mutex_lock(&dsi_panel->stats_lock);
+	(*counter)++;
+	mutex_unlock(&dsi_panel->stats_lock);
+}
+
+/* ret is the result of the transfer, negative on error */
+static void mipi_dsi_panel_record(struct mipi_dsi_panel *dsi_panel, const u8 *data,
+				  size_t len, bool read, int ret)
+{
+	struct mipi_dsi_panel_capture *rec;
+
+	if (!READ_ONCE(dsi_panel->capturing))
+		return;
+
+	mutex_lock(&dsi_panel->stats_lock);
+	rec = &dsi_panel->capture[dsi_panel->capture_count++ % MIPI_DSI_PANEL_CAPTURE_SIZE];
+	rec->time = ktime_get();
+	rec->len = min_t(size_t, len, U8_MAX);
+	memcpy(rec->data, data, min_t(size_t, len, MIPI_DSI_PANEL_CAPTURE_BYTES));
+	rec->read = read;
+	rec->ret = ret < 0 ? ret : 0;
+	mutex_unlock(&dsi_panel->stats_lock);
+}
+
+/* A DCS command without parameters, like mipi_dsi_dcs_exit_sleep_mode() */
+static int mipi_dsi_panel_dcs(struct mipi_dsi_panel *dsi_panel, u8 cmd)
+{
+	int ret = mipi_dsi_dcs_write_buffer(dsi_panel->dsi, &cmd, 1);
+
+	mipi_dsi_panel_record(dsi_panel, &cmd, 1, false, ret);
+
+	return ret < 0 ? ret : 0;
+}
+
+static int mipi_dsi_panel_dcs_read(struct mipi_dsi_panel *dsi_panel, u8 cmd, u8 *val)
+{
+	int ret = mipi_dsi_dcs_read(dsi_panel->dsi, cmd, val, 1);
+
+	mipi_dsi_panel_record(dsi_panel, &cmd, 1, true, ret);
+	if (ret == 1)
+		return 0;
+
+	return ret < 0 ? ret : -EIO;
+}
+
+/* Use the fast delay if there is one and it is shorter, both in us */
+static unsigned int mipi_dsi_panel_fast_us(unsigned int fast_us, unsigned int fixed_us)
+{
+	return fast_us && fast_us < fixed_us ? fast_us : fixed_us;
+}
+
+static void mipi_dsi_panel_delay(struct mipi_dsi_panel *dsi_panel,
+				 unsigned int fast_us, unsigned int ms)
+{
+	unsigned int us;
+
+	/* msleep() rounds up to jiffies, msleep(5) takes 12 ms with HZ=250 */
+	if (!dsi_panel->fast) {
+		msleep(ms);
+		return;
+	}
+
+	us = mipi_dsi_panel_fast_us(fast_us, ms * 1000);
+	if (us)
+		usleep_range(us, us + us / 8);
+}
+
+/* Returns 0 once a bit in mask is set, -ETIMEDOUT or the read error else */
+static int mipi_dsi_panel_poll_power_mode(struct mipi_dsi_panel *dsi_panel,
+					  u8 mask, unsigned int timeout_us)
+{
+	u8 mode = 0;
+	int err;
+	int ret;
+
+	ret = read_poll_timeout(mipi_dsi_panel_dcs_read, err, err || (mode & mask),
+				MIPI_DSI_PANEL_POLL_US, timeout_us, false,
+				dsi_panel, MIPI_DCS_GET_POWER_MODE, &mode);
+
+	return ret ? ret : err;
+}
+
+/* Delay of ms after cmd in the init sequence, cmd is 0 if it had parameters */
+static void mipi_dsi_panel_seq_delay(struct mipi_dsi_panel *dsi_panel, u8 cmd,
+				     unsigned int ms)
+{
+	const struct mipi_dsi_panel_fast_delays *fast = dsi_panel->fast;
+	unsigned int min_us = 0;
+	unsigned int us;
+	u8 mask;
+	int ret;
+
+	if (!fast) {
+		msleep(ms);
+		return;
+	}
+
+	if (cmd == MIPI_DCS_EXIT_SLEEP_MODE || cmd == MIPI_DCS_SET_DISPLAY_ON) {
+		if (!fast->poll_power_mode) {
+			mipi_dsi_panel_delay(dsi_panel, 0, ms);
+			return;
+		}
+
+		/* The power mode says sleep out long before the panel is ready */
+		if (cmd == MIPI_DCS_EXIT_SLEEP_MODE) {
+			min_us = min(fast->sleep_out ?: MIPI_DSI_PANEL_SLEEP_OUT_DELAY * 1000,
+				     ms * 1000);
+			usleep_range(min_us, min_us + min_us / 8);
+			if (min_us == ms * 1000)
+				return;
+		}
+
+		mask = cmd == MIPI_DCS_EXIT_SLEEP_MODE ?
+			MIPI_DCS_POWER_MODE_SLEEP : MIPI_DCS_POWER_MODE_DISPLAY;
+		us = ms * 1000 - min_us;
+		ret = mipi_dsi_panel_poll_power_mode(dsi_panel, mask, us);
+		if (!ret)
+			return;
+		/* The timeout already was the full fixed delay */
+		if (ret == -ETIMEDOUT) {
+			dev_warn(&dsi_panel->dsi->dev, "power mode not ready after %u ms\n", ms);
+			return;
+		}
+		/* Not readable, wait for the rest of the fixed delay */
+		usleep_range(us, us + us / 8);
+		return;
+	}
+
+	mipi_dsi_panel_delay(dsi_panel, ms <= MIPI_DSI_PANEL_SHORT_DELAY ? fast->step : 0, ms);
+}
+
+/* Low power mode as given by the flags of the panel, for commands outside the init sequence */
+static bool mipi_dsi_panel_default_lp(struct mipi_dsi_panel *dsi_panel)
+{
+	return dsi_panel->dsi->mode_flags & MIPI_DSI_MODE_LPM;
+}
+
+static bool mipi_dsi_panel_burst_lp(struct mipi_dsi_panel *dsi_panel, bool awake)
+{
+	switch (dsi_panel->init_xfer) {
+	case MIPI_DSI_PANEL_XFER_LP:
+		return true;
+	case MIPI_DSI_PANEL_XFER_HS:
+		return false;
+	case MIPI_DSI_PANEL_XFER_LP_UNTIL_SLEEP_OUT:
+		return !awake;
+	default:
+		return mipi_dsi_panel_default_lp(dsi_panel);
+	}
+}
+
+static bool mipi_dsi_panel_is_page_cmd(struct mipi_dsi_panel *dsi_panel,
+				       const u8 *data, size_t n)
+{
+	return dsi_panel->desc->page_cmd && data[0] == dsi_panel->desc->page_cmd && n > 1;
+}
+
+/* Memory writes carry pixel data, commands without parameters are actions */
+static bool mipi_dsi_panel_shadow_cacheable(const u8 *data, size_t n)
+{
+	return n > 1 && data[0] != MIPI_DCS_WRITE_MEMORY_START &&
+	       data[0] != MIPI_DCS_WRITE_MEMORY_CONTINUE;
+}
+
+static struct mipi_dsi_panel_shadow_reg *
+mipi_dsi_panel_shadow_find(struct mipi_dsi_panel_shadow *shadow, u8 reg)
+{
+	struct mipi_dsi_panel_shadow_reg *entry;
+	unsigned int i;
+
+	for (i = 0; i < shadow->num_regs; i++) {
+		entry = &shadow->regs[i];
+		if (entry->data[0] == reg && entry->page.len == shadow->page.len &&
+		    !memcmp(entry->page.sel, shadow->page.sel, shadow->page.len))
+			return entry;
+	}
+
+	return NULL;
+}
+
+/* The panel was reset or powered off, it is on its default page */
+static void mipi_dsi_panel_shadow_reset(struct mipi_dsi_panel *dsi_panel)
+{
+	struct mipi_dsi_panel_shadow *shadow = &dsi_panel->shadow;
+
+	mutex_lock(&dsi_panel->shadow_lock);
+	shadow->num_regs = 0;
+	shadow->page.len = 0;
+	shadow->page_known = true;
+	mutex_unlock(&dsi_panel->shadow_lock);
+}
+
+/* Whether sending the command would leave the panel unchanged */
+static bool mipi_dsi_panel_shadow_skip(struct mipi_dsi_panel *dsi_panel,
+				       const u8 *data, size_t n)
+{
+	struct mipi_dsi_panel_shadow *shadow = &dsi_panel->shadow;
+	struct mipi_dsi_panel_shadow_reg *entry;
+
+	if (!shadow->regs || !shadow->page_known)
+		return false;
+
+	if (mipi_dsi_panel_is_page_cmd(dsi_panel, data, n))
+		return n - 1 == shadow->page.len && !memcmp(&data[1], shadow->page.sel, n - 1);
+
+	if (!mipi_dsi_panel_shadow_cacheable(data, n))
+		return false;
+
+	entry = mipi_dsi_panel_shadow_find(shadow, data[0]);
+
+	return entry && entry->len == n && !memcmp(entry->data, data, n);
+}
+
+static void mipi_dsi_panel_shadow_update(struct mipi_dsi_panel *dsi_panel,
+					 const u8 *data, size_t n, bool ok)
+{
+	struct mipi_dsi_panel_shadow *shadow = &dsi_panel->shadow;
+	struct mipi_dsi_panel_shadow_reg *entry;
+
+	if (!shadow->regs)
+		return;
+
+	if (mipi_dsi_panel_is_page_cmd(dsi_panel, data, n)) {
+		/*
+		 * After a failed page command the following writes may end up
+		 * on either page, nothing is known until the next one succeeds.
+		 */
+		if (!ok || n - 1 > MIPI_DSI_PANEL_SHADOW_PAGE_LEN) {
+			shadow->num_regs = 0;
+			shadow->page_known = false;
+			return;
+		}
+		shadow->page.len = n - 1;
+		memcpy(shadow->page.sel, &data[1], n - 1);
+		shadow->page_known = true;
+		return;
+	}
+
+	if (!shadow->page_known || !mipi_dsi_panel_shadow_cacheable(data, n))
+		return;
+
+	entry = mipi_dsi_panel_shadow_find(shadow, data[0]);
+	if (!ok || n > MIPI_DSI_PANEL_SHADOW_REG_LEN) {
+		/* The value on the panel is unknown now */
+		if (entry)
+			*entry = shadow->regs[--shadow->num_regs];
+		return;
+	}
+
+	if (!entry) {
+		/* Still correct if full, the register is just always written */
+		if (shadow->num_regs == shadow->max_regs)
+			return;
+		entry = &shadow->regs[shadow->num_regs++];
+		entry->page = shadow->page;
+	}
+	entry->len = n;
+	memcpy(entry->data, data, n);
+}
+
+/* Panels with a page command get room for every register of the init sequence */
+static int mipi_dsi_panel_shadow_alloc(struct mipi_dsi_panel *dsi_panel)
+{
+	const struct mipi_dsi_panel_seq *seq = &dsi_panel->init_seq;
+	struct mipi_dsi_panel_shadow *shadow = &dsi_panel->shadow;
+	unsigned int num_regs = MIPI_DSI_PANEL_SHADOW_EXTRA;
+	size_t pos = 0;
+	u8 len;
+
+	if (!dsi_panel->desc->page_cmd)
+		return 0;
+
+	while (pos < seq->len) {
+		len = seq->data[pos++];
+		if (len > 1)
+			num_regs++;
+		pos += len ? len : 2;
+	}
+
+	shadow->regs = devm_kcalloc(&dsi_panel->dsi->dev, num_regs, sizeof(*shadow->regs),
+				    GFP_KERNEL);
+	if (!shadow->regs)
+		return -ENOMEM;
+	shadow->max_regs = num_regs;
+
+	return 0;
+}
+
+/*
+ * Send the commands of one burst back to back, data holds len bytes of
+ * sequence steps without delays, sent in low power mode if lp is set. cmd is
+ * set to the last command if it had no parameters, 0 otherwise. Commands that
+ * would not change the panel are skipped. The caller holds shadow_lock.
+ */
+static int mipi_dsi_panel_send_burst(struct mipi_dsi_panel *dsi_panel,
+				     const u8 *data, size_t len, bool lp, u8 *cmd)
+{
+	struct mipi_dsi_device *dsi = dsi_panel->dsi;
+	unsigned long mode_flags = dsi->mode_flags;
+	ktime_t start = ktime_get();
+	unsigned int writes = 0;
+	unsigned int retries = 0;
+	unsigned int skipped = 0;
+	unsigned int cmds = 0;
+	unsigned int attempt;
+	size_t pos = 0;
+	int err = 0;
+	int ret;
+	u8 n;
+
+	lockdep_assert_held(&dsi_panel->shadow_lock);
+
+	/* The core takes the transmission mode of each message from the flags */
+	if (lp)
+		dsi->mode_flags |= MIPI_DSI_MODE_LPM;
+	else
+		dsi->mode_flags &= ~MIPI_DSI_MODE_LPM;
+
+	while (pos < len) {
+		n = data[pos++];
+
+		if (mipi_dsi_panel_shadow_skip(dsi_panel, &data[pos], n)) {
+			*cmd = 0;
+			pos += n;
+			skipped++;
+			continue;
+		}
+
+		/*
+		 * Only repeat the failed command, a disturbed transfer does not
+		 * change the panel state. Keep going if it still fails, the
+		 * following commands are independent and the caller decides
+		 * whether the panel needs to be reset.
+		 */
+		for (attempt = 0; ; attempt++) {
+			ret = mipi_dsi_dcs_write_buffer(dsi, &data[pos], n);
+			trace_panel_mipi_dsi_cmd(&dsi->dev, data[pos], n, attempt,
+						 ret < 0 ? ret : 0);
+			mipi_dsi_panel_record(dsi_panel, &data[pos], n, false, ret);
+			writes++;
+			if (ret >= 0 || attempt == MIPI_DSI_PANEL_CMD_RETRIES)
+				break;
+			retries++;
+			usleep_range(100, 200);
+		}
+		if (attempt || ret < 0)
+			mipi_dsi_panel_cmd_failed(dsi_panel, data[pos], attempt + (ret < 0));
+		if (ret < 0 && !err) {
+			dev_err(&dsi->dev, "command 0x%02x failed: %d\n", data[pos], ret);
+			err = ret;
+		}
+		mipi_dsi_panel_shadow_update(dsi_panel, &data[pos], n, ret >= 0);
+
+		*cmd = n == 1 ? data[pos] : 0;
+		pos += n;
+		cmds++;
+	}
+
+	dsi->mode_flags = mode_flags;
+
+	dsi_panel->shadow.sent += cmds;
+	dsi_panel->shadow.skipped += skipped;
+
+	/* A burst that was skipped completely never reached the link */
+	if (cmds)
+		trace_panel_mipi_dsi_burst(&dsi->dev, cmds, len, lp,
+					   ktime_us_delta(ktime_get(), start), err);
+
+	mutex_lock(&dsi_panel->stats_lock);
+	if (cmds)
+		dsi_panel->stats.bursts++;
+	dsi_panel->stats.writes += writes;
+	dsi_panel->stats.retries += retries;
+	dsi_panel->stats.skipped += skipped;
+	mutex_unlock(&dsi_panel->stats_lock);
+
+	return err;
+}
+
+#if MIPI_DSI_PANEL_DSC
+/*
+ * Rate control parameters for DSC 1.1 from the slices and the mode, the
+ * helpers only know the tables of the VESA reference for some bpc and bpp
+ * combinations and fail for the others.
+ */
+static int mipi_dsi_panel_dsc_setup(struct mipi_dsi_panel *dsi_panel,
+				    const struct drm_display_mode *mode)
+{
+	const struct mipi_dsi_panel_dsc *params = &dsi_panel->dsc;
+	struct drm_dsc_config *dsc = &dsi_panel->dsc_config;
+	int ret;
+
+	if (!params->slice_width || !params->slice_height ||
+	    mode->hdisplay % params->slice_width || mode->vdisplay % params->slice_height)
+		return -EINVAL;
+
+	memset(dsc, 0, sizeof(*dsc));
+	dsc->dsc_version_major = 1;
+	dsc->dsc_version_minor = 1;
+	dsc->pic_width = mode->hdisplay;
+	dsc->pic_height = mode->vdisplay;
+	dsc->slice_width = params->slice_width;
+	dsc->slice_height = params->slice_height;
+	dsc->slice_count = mode->hdisplay / params->slice_width;
+	dsc->bits_per_component = params->bits_per_component ?: 8;
+	/* In 1/16 bits */
+	dsc->bits_per_pixel = params->bits_per_pixel << 4;
+	dsc->line_buf_depth = dsc->bits_per_component + 1;
+	dsc->block_pred_enable = true;
+	dsc->convert_rgb = true;
+
+	drm_dsc_set_const_params(dsc);
+	drm_dsc_set_rc_buf_thresh(dsc);
+	ret = drm_dsc_setup_rc_params(dsc, DRM_DSC_1_1_PRE_SCR);
+	if (ret)
+		return ret;
+	dsc->initial_scale_value = drm_dsc_initial_scale_value(dsc);
+
+	return drm_dsc_compute_rc_parameters(dsc);
+}
+
+/*
+ * The PPS for the current mode, then compression on. Both have to reach the
+ * panel before it leaves sleep mode, after every reset and sleep in.
+ */
+static int mipi_dsi_panel_dsc_start(struct mipi_dsi_panel *dsi_panel)
+{
+	struct drm_dsc_picture_parameter_set pps;
+	const u8 on = 1;
+	int ret;
+
+	drm_dsc_pps_payload_pack(&pps, &dsi_panel->dsc_config);
+	ret = mipi_dsi_picture_parameter_set(dsi_panel->dsi, &pps);
+	mipi_dsi_panel_record(dsi_panel, (const u8 *)&pps, sizeof(pps), false, ret);
+	if (ret)
+		return ret;
+
+	ret = mipi_dsi_compression_mode(dsi_panel->dsi, true);
+	mipi_dsi_panel_record(dsi_panel, &on, sizeof(on), false, ret);
+
+	return ret;
+}
+#else
+static int mipi_dsi_panel_dsc_setup(struct mipi_dsi_panel *dsi_panel,
+				    const struct drm_display_mode *mode)
+{
+	return -EOPNOTSUPP;
+}
+
+static int mipi_dsi_panel_dsc_start(struct mipi_dsi_panel *dsi_panel)
+{
+	return -EOPNOTSUPP;
+}
+#endif
+
+/*
+ * The delay after a burst that was skipped completely is skipped as well,
+ * there was no change the panel needs time for. With DSC the PPS is sent
+ * right before exit sleep mode, or at the end if the sequence has none.
+ * The caller holds shadow_lock.
+ */
+static int mipi_dsi_panel_run_seq(struct mipi_dsi_panel *dsi_panel,
+				  const struct mipi_dsi_panel_seq *seq)
+{
+	const u8 *data = seq->data;
+	bool dsc = dsi_panel->dsi->dsc;
+	unsigned int sent;
+	bool changed = true;
+	bool awake = false;
+	size_t pos = 0;
+	size_t end;
+	int err = 0;
+	u8 cmd = 0;
+	int ret;
+
+	while (pos < seq->len) {
+		if (!data[pos]) {
+			if (pos + 3 > seq->len)
+				return -EINVAL;
+			if (changed)
+				mipi_dsi_panel_seq_delay(dsi_panel, cmd,
+							 get_unaligned_le16(&data[pos + 1]));
+			pos += 3;
+			cmd = 0;
+			continue;
+		}
+
+		/*
+		 * Everything up to the next delay or exit sleep mode is one burst,
+		 * with DSC exit sleep mode is a burst of its own
+		 */
+		for (end = pos; end < seq->len && data[end]; end += data[end] + 1) {
+			if (end + data[end] + 1 > seq->len)
+				return -EINVAL;
+			if (data[end] == 1 && data[end + 1] == MIPI_DCS_EXIT_SLEEP_MODE) {
+				if (!dsc || end == pos)
+					end += 2;
+				break;
+			}
+		}
+
+		if (dsc && data[pos] == 1 && data[pos + 1] == MIPI_DCS_EXIT_SLEEP_MODE) {
+			ret = mipi_dsi_panel_dsc_start(dsi_panel);
+			if (ret < 0 && !err)
+				err = ret;
+			dsc = false;
+		}
+
+		sent = dsi_panel->shadow.sent;
+		ret = mipi_dsi_panel_send_burst(dsi_panel, &data[pos], end - pos,
+						mipi_dsi_panel_burst_lp(dsi_panel, awake), &cmd);
+		if (ret < 0 && !err)
+			err = ret;
+		changed = dsi_panel->shadow.sent != sent;
+		if (cmd == MIPI_DCS_EXIT_SLEEP_MODE)
+			awake = true;
+		pos = end;
+	}
+
+	if (dsc) {
+		ret = mipi_dsi_panel_dsc_start(dsi_panel);
+		if (ret < 0 && !err)
+			err = ret;
+	}
+
+	return err;
+}
+
+/* Send a single command outside of a sequence, skipped if it changes nothing */
+static int mipi_dsi_panel_write(struct mipi_dsi_panel *dsi_panel, const u8 *data, u8 len)
+{
+	u8 step[256];
+	u8 cmd;
+	int ret;
+
+	step[0] = len;
+	memcpy(&step[1], data, len);
+
+	mutex_lock(&dsi_panel->shadow_lock);
+	ret = mipi_dsi_panel_send_burst(dsi_panel, step, len + 1,
+					mipi_dsi_panel_default_lp(dsi_panel), &cmd);
+	mutex_unlock(&dsi_panel->shadow_lock);
+
+	return ret;
+}
+
+/*
+ * Tearing effect output and the full screen as frame memory area, after every
+ * wake. A new area changes the resolution, which runs this again. Partial
+ * updates are not supported: drm_panel gets no plane damage, and the host,
+ * which sends the frames, would have to set a smaller area per frame itself.
+ */
+static int mipi_dsi_panel_cmd_mode_start(struct mipi_dsi_panel *dsi_panel)
+{
+	u16 x2 = dsi_panel->mode->hdisplay - 1;
+	u16 y2 = dsi_panel->mode->vdisplay - 1;
+	const u8 burst[] = {
+		2, MIPI_DCS_SET_TEAR_ON, MIPI_DSI_DCS_TEAR_MODE_VBLANK,
+		5, MIPI_DCS_SET_COLUMN_ADDRESS, 0, 0, x2 >> 8, x2 & 0xff,
+		5, MIPI_DCS_SET_PAGE_ADDRESS, 0, 0, y2 >> 8, y2 & 0xff,
+	};
+	u8 cmd;
+	int ret;
+
+	mutex_lock(&dsi_panel->shadow_lock);
+	ret = mipi_dsi_panel_send_burst(dsi_panel, burst, sizeof(burst),
+					mipi_dsi_panel_default_lp(dsi_panel), &cmd);
+	mutex_unlock(&dsi_panel->shadow_lock);
+
+	return ret;
+}
+
+/* Bits per pixel on the link, after compression if DSC is used */
+static int mipi_dsi_panel_link_bpp(struct mipi_dsi_panel *dsi_panel)
+{
+	if (dsi_panel->dsi->dsc)
+		return dsi_panel->dsc.bits_per_pixel;
+
+	return mipi_dsi_pixel_format_to_bpp(dsi_panel->dsi->format);
+}
+
+/* Everything after the init sequence that a reset or power off undoes */
+static int mipi_dsi_panel_start(struct mipi_dsi_panel *dsi_panel)
+{
+	if (dsi_panel->cmd_mode)
+		return mipi_dsi_panel_cmd_mode_start(dsi_panel);
+
+	return 0;
+}
+
+/*
+ * Approximate bytes on the link per frame. Each long packet adds a 4 byte
+ * header and a 2 byte checksum. In video mode every line is one packet plus
+ * a 4 byte sync packet, blanking lines only have the sync packet.
+ */
+static u64 mipi_dsi_panel_video_bytes(struct mipi_dsi_panel *dsi_panel)
+{
+	const struct drm_display_mode *mode = dsi_panel->mode;
+	int bpp = mipi_dsi_panel_link_bpp(dsi_panel);
+
+	return (u64)mode->vdisplay * (mode->hdisplay * bpp / 8 + 6) + mode->vtotal * 4;
+}
+
+/* Walk the sequence without sending anything to check it is well formed */
+static bool mipi_dsi_panel_seq_valid(const struct mipi_dsi_panel_seq *seq)
+{
+	size_t pos = 0;
+	u8 len;
+
+	while (pos < seq->len) {
+		len = seq->data[pos++];
+		pos += len ? len : 2;
+	}
+
+	return pos == seq->len;
+}
+
+/*
+ * Checked once at probe for the built-in mode or the one from firmware: no
+ * porch or sync pulse may be empty, the refresh rate has to be in range and,
+ * if the lane rate of the panel is known, the pixels have to fit into the
+ * lanes, compressed if DSC is used. fw-compiler does the same checks when it
+ * writes a descriptor.
+ */
+static int mipi_dsi_panel_check_mode(struct mipi_dsi_panel *dsi_panel,
+				     const struct drm_display_mode *mode)
+{
+	struct device *dev = &dsi_panel->dsi->dev;
+	int bpp = mipi_dsi_panel_link_bpp(dsi_panel);
+	unsigned int max_rate = dsi_panel->desc->max_lane_rate;
+	unsigned int lanes = dsi_panel->dsi->lanes;
+	int vrefresh;
+	u64 rate;
+
+	if (!mode->hdisplay || mode->hsync_start <= mode->hdisplay ||
+	    mode->hsync_end <= mode->hsync_start || mode->htotal <= mode->hsync_end ||
+	    !mode->vdisplay || mode->vsync_start <= mode->vdisplay ||
+	    mode->vsync_end <= mode->vsync_start || mode->vtotal <= mode->vsync_end) {
+		dev_err(dev, "mode %ux%u has an empty porch or sync pulse\n",
+			mode->hdisplay, mode->vdisplay);
+		return -EINVAL;
+	}
+
+	vrefresh = drm_mode_vrefresh(mode);
+	if (vrefresh < MIPI_DSI_PANEL_MIN_VREFRESH || vrefresh > MIPI_DSI_PANEL_MAX_VREFRESH) {
+		dev_err(dev, "mode %ux%u has an invalid refresh rate of %d Hz\n",
+			mode->hdisplay, mode->vdisplay, vrefresh);
+		return -EINVAL;
+	}
+
+	/* kHz times bits per pixel is kbps, spread over the lanes */
+	rate = div_u64((u64)mode->clock * bpp + lanes - 1, lanes);
+	if (max_rate && rate > max_rate) {
+		dev_err(dev, "mode %ux%u@%d needs %llu kbps per lane, the panel takes %u\n",
+			mode->hdisplay, mode->vdisplay, vrefresh, rate, max_rate);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/* With DSC the mode also needs rate control parameters, the host gets them at attach */
+static int mipi_dsi_panel_check_modes(struct mipi_dsi_panel *dsi_panel)
+{
+	struct mipi_dsi_device *dsi = dsi_panel->dsi;
+	const struct drm_display_mode *mode = dsi_panel->mode;
+	int ret;
+
+	if (dsi->dsc && (!dsi_panel->dsc.bits_per_pixel ||
+			 dsi_panel->dsc.bits_per_pixel >= mipi_dsi_pixel_format_to_bpp(dsi->format))) {
+		dev_err(&dsi->dev, "DSC needs fewer bits per pixel than the format\n");
+		return -EINVAL;
+	}
+
+	ret = mipi_dsi_panel_check_mode(dsi_panel, mode);
+	if (ret || !dsi->dsc)
+		return ret;
+
+	ret = mipi_dsi_panel_dsc_setup(dsi_panel, mode);
+	if (ret)
+		dev_err(&dsi->dev, "no DSC parameters for mode %ux%u: %d\n",
+			mode->hdisplay, mode->vdisplay, ret);
+
+	return ret;
+}
+
+/*
+ * Init sequences, timings and delays can also be loaded as firmware. The blob
+ * starts with this header, all values are little endian. The crc32 covers
+ * everything after the crc32 field up to size. A clock of 0 keeps the built-in
+ * mode. The init sequence uses the same format as the built-in tables and
+ * follows the header. The blob is built by fw-compiler.
+ */
+#define MIPI_DSI_PANEL_FW_MAGIC		0x50495344 /* "DSIP" */
+#define MIPI_DSI_PANEL_FW_VERSION	1
+#define MIPI_DSI_PANEL_FW_FLAG_INIT_LPM	BIT(0)
+#define MIPI_DSI_PANEL_FW_FLAG_INIT_HS	BIT(1)
+#define MIPI_DSI_PANEL_FW_FLAG_INIT_LP_UNTIL_SLEEP_OUT	BIT(2)
+#define MIPI_DSI_PANEL_FW_FLAG_CMD_MODE	BIT(3)
+
+struct mipi_dsi_panel_fw_header {
+	__le32 magic;
+	__le16 version;
+	__le16 header_size;
+	__le32 size;
+	__le32 crc32;
+
+	__le32 clock;
+	__le16 hdisplay;
+	__le16 hsync_start;
+	__le16 hsync_end;
+	__le16 htotal;
+	__le16 vdisplay;
+	__le16 vsync_start;
+	__le16 vsync_end;
+	__le16 vtotal;
+	__le16 width_mm;
+	__le16 height_mm;
+	__le32 mode_flags;
+
+	__le16 power_on_delay;
+	__le16 reset_delay;
+	__le16 sleep_delay;
+	__le16 flags;
+	__le32 init_seq_len;
+} __packed;
+
+static int mipi_dsi_panel_parse_firmware(struct mipi_dsi_panel *dsi_panel,
+					 const struct firmware *fw)
+{
+	const struct mipi_dsi_panel_fw_header *hdr = (const void *)fw->data;
+	struct device *dev = &dsi_panel->dsi->dev;
+	size_t crc_offset = offsetofend(struct mipi_dsi_panel_fw_header, crc32);
+	struct drm_display_mode *mode;
+	unsigned int header_size;
+	size_t init_seq_len;
+	u16 flags;
+	u32 crc;
+
+	if (fw->size < sizeof(*hdr) || le32_to_cpu(hdr->magic) != MIPI_DSI_PANEL_FW_MAGIC) {
+		dev_err(dev, "invalid firmware\n");
+		return -EINVAL;
+	}
+
+	if (le16_to_cpu(hdr->version) != MIPI_DSI_PANEL_FW_VERSION) {
+		dev_err(dev, "unsupported firmware version %u\n", le16_to_cpu(hdr->version));
+		return -EINVAL;
+	}
+
+	header_size = le16_to_cpu(hdr->header_size);
+	init_seq_len = le32_to_cpu(hdr->init_seq_len);
+	/* No sum that could wrap with a 32 bit size_t */
+	if (le32_to_cpu(hdr->size) != fw->size || header_size < sizeof(*hdr) ||
+	    header_size > fw->size || init_seq_len != fw->size - header_size) {
+		dev_err(dev, "invalid firmware size\n");
+		return -EINVAL;
+	}
+
+	crc = crc32_le(~0, fw->data + crc_offset, fw->size - crc_offset) ^ ~0;
+	if (crc != le32_to_cpu(hdr->crc32)) {
+		dev_err(dev, "firmware crc mismatch\n");
+		return -EINVAL;
+	}
+
+	dsi_panel->init_seq.data = devm_kmemdup(dev, fw->data + header_size, init_seq_len,
+						GFP_KERNEL);
+	if (!dsi_panel->init_seq.data)
+		return -ENOMEM;
+	dsi_panel->init_seq.len = init_seq_len;
+	if (!mipi_dsi_panel_seq_valid(&dsi_panel->init_seq)) {
+		dev_err(dev, "invalid init sequence in firmware\n");
+		return -EINVAL;
+	}
+
+	if (hdr->clock) {
+		mode = devm_kzalloc(dev, sizeof(*mode), GFP_KERNEL);
+		if (!mode)
+			return -ENOMEM;
+
+		mode->clock = le32_to_cpu(hdr->clock);
+		mode->hdisplay = le16_to_cpu(hdr->hdisplay);
+		mode->hsync_start = le16_to_cpu(hdr->hsync_start);
+		mode->hsync_end = le16_to_cpu(hdr->hsync_end);
+		mode->htotal = le16_to_cpu(hdr->htotal);
+		mode->vdisplay = le16_to_cpu(hdr->vdisplay);
+		mode->vsync_start = le16_to_cpu(hdr->vsync_start);
+		mode->vsync_end = le16_to_cpu(hdr->vsync_end);
+		mode->vtotal = le16_to_cpu(hdr->vtotal);
+		mode->width_mm = le16_to_cpu(hdr->width_mm);
+		mode->height_mm = le16_to_cpu(hdr->height_mm);
+		mode->flags = le32_to_cpu(hdr->mode_flags);
+		mode->type = DRM_MODE_TYPE_DRIVER | DRM_MODE_TYPE_PREFERRED;
+		dsi_panel->mode = mode;
+	}
+
+	dsi_panel->power_on_delay = le16_to_cpu(hdr->power_on_delay);
+	dsi_panel->reset_delay = le16_to_cpu(hdr->reset_delay);
+	dsi_panel->sleep_delay = le16_to_cpu(hdr->sleep_delay);
+	/* The register values of the built-in sequence may not apply */
+	dsi_panel->num_verify = 0;
+
+	flags = le16_to_cpu(hdr->flags);
+	if (flags & MIPI_DSI_PANEL_FW_FLAG_INIT_LPM)
+		dsi_panel->init_xfer = MIPI_DSI_PANEL_XFER_LP;
+	else if (flags & MIPI_DSI_PANEL_FW_FLAG_INIT_HS)
+		dsi_panel->init_xfer = MIPI_DSI_PANEL_XFER_HS;
+	else if (flags & MIPI_DSI_PANEL_FW_FLAG_INIT_LP_UNTIL_SLEEP_OUT)
+		dsi_panel->init_xfer = MIPI_DSI_PANEL_XFER_LP_UNTIL_SLEEP_OUT;
+	else
+		dsi_panel->init_xfer = MIPI_DSI_PANEL_XFER_DEFAULT;
+	dsi_panel->cmd_mode = flags & MIPI_DSI_PANEL_FW_FLAG_CMD_MODE;
+
+	return 0;
+}
+
+/*
+ * Load the firmware named by firmware-name. Without the property the built-in
+ * descriptor is used and no lookup is done, a synchronous request for a file
+ * that does not exist can stall probe with the user helper fallback enabled.
+ * The blob is parsed once here, prepare and enable only use the parsed copy.
+ */
+static int mipi_dsi_panel_load_firmware(struct mipi_dsi_panel *dsi_panel)
+{
+	struct device *dev = &dsi_panel->dsi->dev;
+	const struct firmware *fw;
+	const char *name;
+	int ret;
+
+	if (of_property_read_string(dev->of_node, "firmware-name", &name))
+		return 0;
+
+	ret = firmware_request_nowarn(&fw, name, dev);
+	if (ret) {
+		dev_warn(dev, "firmware %s not found, using built-in init sequence\n", name);
+		return 0;
+	}
+
+	ret = mipi_dsi_panel_parse_firmware(dsi_panel, fw);
+	if (!ret)
+		dev_info(dev, "using init sequence from %s\n", name);
+
+	release_firmware(fw);
+
+	return ret;
+}
+
+/* Replace the delays of the init sequence in order, the first count of them */
+static int mipi_dsi_panel_parse_dt_init_delays(struct mipi_dsi_panel *dsi_panel)
+{
+	struct mipi_dsi_panel_seq *seq = &dsi_panel->init_seq;
+	struct device *dev = &dsi_panel->dsi->dev;
+	int count, i = 0;
+	size_t pos = 0;
+	u32 *delays;
+	u8 *data;
+	u8 len;
+	int ret;
+
+	count = of_property_count_u32_elems(dev->of_node, "init-delays-ms");
+	if (count == -EINVAL)
+		return 0;
+	if (count < 0)
+		return count;
+
+	delays = kcalloc(count, sizeof(*delays), GFP_KERNEL);
+	data = devm_kmemdup(dev, seq->data, seq->len, GFP_KERNEL);
+	if (!delays || !data) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = of_property_read_u32_array(dev->of_node, "init-delays-ms", delays, count);
+	if (ret)
+		goto out;
+
+	while (pos < seq->len && i < count) {
+		len = data[pos++];
+		if (len) {
+			pos += len;
+			continue;
+		}
+		if (delays[i] > U16_MAX) {
+			dev_err(dev, "init delay %u ms too long\n", delays[i]);
+			ret = -EINVAL;
+			goto out;
+		}
+		put_unaligned_le16(delays[i++], &data[pos]);
+		pos += 2;
+	}
+	if (i < count) {
+		dev_err(dev, "init-delays-ms has %d entries, the init sequence only %d delays\n",
+			count, i);
+		ret = -EINVAL;
+		goto out;
+	}
+	seq->data = data;
+
+out:
+	kfree(delays);
+
+	return ret;
+}
+
+/*
+ * Board specific overrides from the panel node, applied after the firmware:
+ * a panel-timing child node replaces the mode, power-on-delay-ms,
+ * reset-delay-ms and sleep-delay-ms the delays around prepare and
+ * init-delays-ms the delays in the init sequence. dsc-slice-width,
+ * dsc-slice-height, dsc-bits-per-component and dsc-bits-per-pixel replace the
+ * DSC parameters. Everything ends up in the same fields the built-in
+ * descriptor fills, once at probe.
+ */
+static int mipi_dsi_panel_parse_dt(struct mipi_dsi_panel *dsi_panel)
+{
+	struct device *dev = &dsi_panel->dsi->dev;
+	struct device_node *np = dev->of_node;
+	struct drm_display_mode mode = { };
+	u32 val;
+	int ret;
+
+	of_property_read_u32(np, "power-on-delay-ms", &dsi_panel->power_on_delay);
+	of_property_read_u32(np, "reset-delay-ms", &dsi_panel->reset_delay);
+	of_property_read_u32(np, "sleep-delay-ms", &dsi_panel->sleep_delay);
+
+	ret = mipi_dsi_panel_parse_dt_init_delays(dsi_panel);
+	if (ret)
+		return ret;
+
+	if (!of_property_read_u32(np, "dsc-slice-width", &val))
+		dsi_panel->dsc.slice_width = val;
+	if (!of_property_read_u32(np, "dsc-slice-height", &val))
+		dsi_panel->dsc.slice_height = val;
+	if (!of_property_read_u32(np, "dsc-bits-per-component", &val))
+		dsi_panel->dsc.bits_per_component = val;
+	if (!of_property_read_u32(np, "dsc-bits-per-pixel", &val))
+		dsi_panel->dsc.bits_per_pixel = val;
+
+	ret = of_get_drm_panel_display_mode(np, &mode, NULL);
+	if (ret == -ENOENT)
+		return 0;
+	if (ret) {
+		dev_err(dev, "invalid panel-timing: %d\n", ret);
+		return ret;
+	}
+
+	/* The size of the panel does not change with the board */
+	if (!mode.width_mm || !mode.height_mm) {
+		mode.width_mm = dsi_panel->mode->width_mm;
+		mode.height_mm = dsi_panel->mode->height_mm;
+	}
+	mode.type = DRM_MODE_TYPE_DRIVER | DRM_MODE_TYPE_PREFERRED;
+
+	dsi_panel->mode = devm_kmemdup(dev, &mode, sizeof(mode), GFP_KERNEL);
+	if (!dsi_panel->mode)
+		return -ENOMEM;
+	dev_info(dev, "using panel-timing %ux%u@%d from the device tree\n",
+		 mode.hdisplay, mode.vdisplay, drm_mode_vrefresh(&mode));
+
+	return 0;
+}
+
+static const u8 ts070wsh02ce_init_seq[] = {
+	MIPI_DSI_SEQ_CMD(0x80, 0x8B),
+	MIPI_DSI_SEQ_CMD(0x81, 0x78),
+	MIPI_DSI_SEQ_CMD(0x82, 0x84),
+	MIPI_DSI_SEQ_CMD(0x83, 0x88),
+	MIPI_DSI_SEQ_CMD(0x84, 0xA8),
+	MIPI_DSI_SEQ_CMD(0x85, 0xE3),
+	MIPI_DSI_SEQ_CMD(0x86, 0x88),
+
+	MIPI_DSI_SEQ_CMD(MIPI_DCS_EXIT_SLEEP_MODE),
+	MIPI_DSI_SEQ_CMD(MIPI_DCS_SET_DISPLAY_ON),
+};
+
+
+static const u8 wf70a8syahmngb_init_seq[] = {
+	MIPI_DSI_SEQ_CMD(0xB1, 0x30),
+	MIPI_DSI_SEQ_DELAY(5),
+
+	MIPI_DSI_SEQ_CMD(0x80, 0x5B),
+	MIPI_DSI_SEQ_CMD(0x81, 0x47),
+	MIPI_DSI_SEQ_CMD(0x82, 0x84),
+	MIPI_DSI_SEQ_CMD(0x83, 0x88),
+	MIPI_DSI_SEQ_CMD(0x84, 0x88),
+	MIPI_DSI_SEQ_CMD(0x85, 0x23),
+	MIPI_DSI_SEQ_CMD(0x86, 0xB6),
+
+	MIPI_DSI_SEQ_CMD(MIPI_DCS_EXIT_SLEEP_MODE),
+	MIPI_DSI_SEQ_CMD(MIPI_DCS_SET_DISPLAY_ON),
+};
+
+/* Command2 disabled, the init sequence leaves BK1 selected */
+static const u8 wf40eswaa6_user_page[] = {
+	MIPI_DSI_SEQ_CMD(0xFF, 0x77, 0x01, 0x00, 0x00, 0x00),
+};
+
+static const u8 wf40eswaa6_init_seq[] = {
+	MIPI_DSI_SEQ_CMD(0x11),
+	MIPI_DSI_SEQ_DELAY(120),
+
+	MIPI_DSI_SEQ_CMD(0xFF, 0x77, 0x01, 0x00, 0x00, 0x10),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xC0, 0x3B, 0x00),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xC1, 0x0D, 0x02),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xC2, 0x30, 0x05),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xB0, 0x01, 0x08, 0x10, 0x0C, 0x10, 0x06, 0x07, 0x08, 0x07, 0x22, 0x04, 0x14, 0x12, 0xB3, 0x3A, 0x1F),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xB1, 0x13, 0x19, 0x1F, 0x0F, 0x14, 0x07, 0x07, 0x08, 0x07, 0x22, 0x02, 0x0F, 0x0F, 0xA3, 0x29, 0x0D),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xFF, 0x77, 0x01, 0x00, 0x00, 0x11),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xB0, 0x60),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xB1, 0x2D),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xB2, 0x07),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xB3, 0x80),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xB5, 0x49),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xB7, 0x85),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xB8, 0x21),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xC1, 0x78),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xC2, 0x78),
+	MIPI_DSI_SEQ_DELAY(100),
+	MIPI_DSI_SEQ_CMD(0xE0, 0x00, 0x28, 0x02),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xE1, 0x08, 0xA0, 0x00, 0x00, 0x07, 0xA0, 0x00, 0x00, 0x00, 0x44, 0x44),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xE2, 0x11, 0x11, 0x44, 0x44, 0xED, 0xA0, 0x00, 0x00, 0xEC, 0xA0, 0x00, 0x00),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xE3, 0x00, 0x00, 0x11, 0x11),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xE4, 0x44, 0x44),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xE5, 0x0A, 0xE9, 0xD8, 0xA0, 0x0C, 0xEB, 0xD8, 0xA0, 0x0E, 0xED, 0xD8, 0xA0, 0x10, 0xEF, 0xD8, 0xA0),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xE6, 0x00, 0x00, 0x11, 0x11),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xE7, 0x44, 0x44),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xE8, 0x09, 0xE8, 0xD8, 0xA0, 0x0B, 0xEA, 0xD8, 0xA0, 0x0D, 0xEC, 0xD8, 0xA0, 0x0F, 0xEE, 0xD8, 0xA0),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xEB, 0x00, 0x00, 0xE4, 0xE4, 0x88, 0x00, 0x40),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xEC, 0x3C, 0x00),
+	MIPI_DSI_SEQ_DELAY(5),
+	MIPI_DSI_SEQ_CMD(0xED, 0xAB, 0x89, 0x76, 0x54, 0x02, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x20, 0x45, 0x67, 0x98, 0xBA),
+	MIPI_DSI_SEQ_DELAY(5),
+
+	MIPI_DSI_SEQ_CMD(0x36, 0x00),
+
+	MIPI_DSI_SEQ_CMD(MIPI_DCS_EXIT_SLEEP_MODE),
+	MIPI_DSI_SEQ_CMD(MIPI_DCS_SET_DISPLAY_ON),
+};
+
+static const u8 am4001280a3tzqw01h_init_seq[] = {
+	MIPI_DSI_SEQ_CMD(0xB0, 0x5A),
+	MIPI_DSI_SEQ_CMD(0xB1, 0x00),
+	MIPI_DSI_SEQ_CMD(0x89, 0x01),
+	MIPI_DSI_SEQ_CMD(0x91, 0x07),
+	MIPI_DSI_SEQ_CMD(0x92, 0xF9),
+	MIPI_DSI_SEQ_CMD(0xB1, 0x03),
+	MIPI_DSI_SEQ_CMD(0x2C, 0x28),
+	MIPI_DSI_SEQ_CMD(0x00, 0xB7),
+	MIPI_DSI_SEQ_CMD(0x01, 0x1B),
+	MIPI_DSI_SEQ_CMD(0x02, 0x00),
+	MIPI_DSI_SEQ_CMD(0x03, 0x00),
+	MIPI_DSI_SEQ_CMD(0x04, 0x00),
+	MIPI_DSI_SEQ_CMD(0x05, 0x00),
+	MIPI_DSI_SEQ_CMD(0x06, 0x00),
+	MIPI_DSI_SEQ_CMD(0x07, 0x00),
+	MIPI_DSI_SEQ_CMD(0x08, 0x00),
+	MIPI_DSI_SEQ_CMD(0x09, 0x00),
+	MIPI_DSI_SEQ_CMD(0x0A, 0x01),
+	MIPI_DSI_SEQ_CMD(0x0B, 0x01),
+	MIPI_DSI_SEQ_CMD(0x0C, 0x20),
+	MIPI_DSI_SEQ_CMD(0x0D, 0x00),
+	MIPI_DSI_SEQ_CMD(0x0E, 0x24),
+	MIPI_DSI_SEQ_CMD(0x0F, 0x1C),
+	MIPI_DSI_SEQ_CMD(0x10, 0xC9),
+	MIPI_DSI_SEQ_CMD(0x11, 0x60),
+	MIPI_DSI_SEQ_CMD(0x12, 0x70),
+	MIPI_DSI_SEQ_CMD(0x13, 0x01),
+	MIPI_DSI_SEQ_CMD(0x14, 0xE7),
+	MIPI_DSI_SEQ_CMD(0x15, 0xFF),
+	MIPI_DSI_SEQ_CMD(0x16, 0x3D),
+	MIPI_DSI_SEQ_CMD(0x17, 0x0E),
+	MIPI_DSI_SEQ_CMD(0x18, 0x01),
+	MIPI_DSI_SEQ_CMD(0x19, 0x00),
+	MIPI_DSI_SEQ_CMD(0x1A, 0x00),
+	MIPI_DSI_SEQ_CMD(0x1B, 0xFC),
+	MIPI_DSI_SEQ_CMD(0x1C, 0x0B),
+	MIPI_DSI_SEQ_CMD(0x1D, 0xA0),
+	MIPI_DSI_SEQ_CMD(0x1E, 0x03),
+	MIPI_DSI_SEQ_CMD(0x1F, 0x04),
+	MIPI_DSI_SEQ_CMD(0x20, 0x0C),
+	MIPI_DSI_SEQ_CMD(0x21, 0x00),
+	MIPI_DSI_SEQ_CMD(0x22, 0x04),
+	MIPI_DSI_SEQ_CMD(0x23, 0x81),
+	MIPI_DSI_SEQ_CMD(0x24, 0x1F),
+	MIPI_DSI_SEQ_CMD(0x25, 0x10),
+	MIPI_DSI_SEQ_CMD(0x26, 0x9B),
+	MIPI_DSI_SEQ_CMD(0x2D, 0x01),
+	MIPI_DSI_SEQ_CMD(0x2E, 0x84),
+	MIPI_DSI_SEQ_CMD(0x2F, 0x00),
+	MIPI_DSI_SEQ_CMD(0x30, 0x02),
+	MIPI_DSI_SEQ_CMD(0x31, 0x08),
+	MIPI_DSI_SEQ_CMD(0x32, 0x01),
+	MIPI_DSI_SEQ_CMD(0x33, 0x1C),
+	MIPI_DSI_SEQ_CMD(0x34, 0x40),
+
+	MIPI_DSI_SEQ_CMD(MIPI_DCS_EXIT_SLEEP_MODE),
+	MIPI_DSI_SEQ_CMD(MIPI_DCS_SET_DISPLAY_ON),
+};
+
+/*
+ * Sent in low power mode, see init_xfer in top055fhd01a_desc. The panel flags
+ * keep high speed mode for the commands sent later.
+ */
+static const u8 top055fhd01a_init_seq[] = {
+	MIPI_DSI_SEQ_CMD(0xFE, 0x04),
+	MIPI_DSI_SEQ_CMD(0x5E, 0x00),
+	MIPI_DSI_SEQ_CMD(0x44, 0x47),
+	MIPI_DSI_SEQ_CMD(0xFE, 0x07),
+	MIPI_DSI_SEQ_CMD(0xA9, 0x6A),
+	MIPI_DSI_SEQ_CMD(0xFE, 0x0A),
+	MIPI_DSI_SEQ_CMD(0x14, 0x52),
+	MIPI_DSI_SEQ_CMD(0xFE, 0x00),
+	MIPI_DSI_SEQ_CMD(0x55, 0x00),
+
+	/* Set video mode to send vsync and hsync pulse */
+	MIPI_DSI_SEQ_CMD(0xC2, 0x03),
+
+	MIPI_DSI_SEQ_CMD(0x51, 0xFF),
+
+	MIPI_DSI_SEQ_CMD(MIPI_DCS_EXIT_SLEEP_MODE),
+	MIPI_DSI_SEQ_DELAY(500),
+	MIPI_DSI_SEQ_CMD(MIPI_DCS_SET_DISPLAY_ON),
+	MIPI_DSI_SEQ_DELAY(100),
+	MIPI_DSI_SEQ_CMD(0xFE, 0x07),
+	MIPI_DSI_SEQ_DELAY(200),
+	MIPI_DSI_SEQ_CMD(0xA9, 0xEA),
+	MIPI_DSI_SEQ_CMD(0xFE, 0x00),
+};
+
+/* Page 0x00 holds the user command set */
+static const u8 top055fhd01a_user_page[] = {
+	MIPI_DSI_SEQ_CMD(0xFE, 0x00),
+};
+
+/* Readable on every panel, power, address, pixel, display and signal mode, diagnostics */
+static const u8 mipi_dsi_panel_default_snapshot[] = {
+	MIPI_DCS_GET_POWER_MODE,
+	MIPI_DCS_GET_ADDRESS_MODE,
+	MIPI_DCS_GET_PIXEL_FORMAT,
+	MIPI_DCS_GET_DISPLAY_MODE,
+	MIPI_DCS_GET_SIGNAL_MODE,
+	MIPI_DCS_GET_DIAGNOSTIC_RESULT,
+};
+
+static const u8 top055fhd01a_snapshot[] = {
+	MIPI_DCS_GET_POWER_MODE,
+	MIPI_DCS_GET_ADDRESS_MODE,
+	MIPI_DCS_GET_PIXEL_FORMAT,
+	MIPI_DCS_GET_DISPLAY_MODE,
+	MIPI_DCS_GET_SIGNAL_MODE,
+	MIPI_DCS_GET_DIAGNOSTIC_RESULT,
+	MIPI_DCS_GET_DISPLAY_BRIGHTNESS,
+	MIPI_DCS_GET_CONTROL_DISPLAY,
+};
+
+static_assert(ARRAY_SIZE(top055fhd01a_snapshot) <= MIPI_DSI_PANEL_SNAPSHOT_REGS);
+
+/* Brightness and power mode written by the init sequence, 0x54 only logged */
+static const struct mipi_dsi_panel_reg_check top055fhd01a_verify[] = {
+	{ MIPI_DCS_GET_DISPLAY_BRIGHTNESS, 0xff, 0xff },
+	{ MIPI_DCS_GET_CONTROL_DISPLAY, 0x00, 0x00 },
+	{ MIPI_DCS_GET_POWER_MODE, MIPI_DCS_POWER_MODE_SLEEP | MIPI_DCS_POWER_MODE_DISPLAY,
+	  MIPI_DCS_POWER_MODE_SLEEP | MIPI_DCS_POWER_MODE_DISPLAY },
+};
+
+static int mipi_dsi_panel_verify(struct mipi_dsi_panel *dsi_panel)
+{
+	const struct mipi_dsi_panel_reg_check *check;
+	struct device *dev = &dsi_panel->dsi->dev;
+	unsigned int i;
+	u8 val;
+	int ret;
+
+	for (i = 0; i < dsi_panel->num_verify; i++) {
+		check = &dsi_panel->verify[i];
+
+		ret = mipi_dsi_panel_dcs_read(dsi_panel, check->reg, &val);
+		/* Nothing to verify if the host can't read at all */
+		if (ret == -EOPNOTSUPP || ret == -ENOSYS) {
+			dev_warn_once(dev, "host can't read, init sequence not verified\n");
+			return 0;
+		}
+		if (ret) {
+			dev_warn(dev, "reading 0x%02x failed: %d\n", check->reg, ret);
+			goto err;
+		}
+
+		dev_dbg(dev, "0x%02x = 0x%02x\n", check->reg, val);
+		if ((val & check->mask) != check->val) {
+			dev_warn(dev, "0x%02x is 0x%02x, expected 0x%02x\n", check->reg,
+				 val & check->mask, check->val);
+			ret = -EIO;
+			goto err;
+		}
+	}
+
+	return 0;
+
+err:
+	mipi_dsi_panel_stats_inc(dsi_panel, &dsi_panel->stats.verify_errors);
+	return ret;
+}
+
+/* Hard reset through the reset GPIO, the supplies stay on */
+static void mipi_dsi_panel_reset(struct mipi_dsi_panel *dsi_panel)
+{
+	const struct mipi_dsi_panel_fast_delays *fast = dsi_panel->fast;
+
+	gpiod_set_value(dsi_panel->reset, 0);
+	mipi_dsi_panel_shadow_reset(dsi_panel);
+	usleep_range(1000, 2000);
+	gpiod_set_value(dsi_panel->reset, 1);
+	mipi_dsi_panel_delay(dsi_panel, fast ? fast->reset : 0, dsi_panel->reset_delay);
+}
+
+/*
+ * Only the registers that differ from the shadow are written, this is the
+ * whole sequence after a reset and just the changes if the panel kept its
+ * registers.
+ */
+static int mipi_dsi_panel_init(struct mipi_dsi_panel *dsi_panel)
+{
+	struct mipi_dsi_panel_shadow *shadow = &dsi_panel->shadow;
+	struct mipi_dsi_device *dsi = dsi_panel->dsi;
+	ktime_t start = ktime_get();
+	unsigned int resets = 0;
+	unsigned int skipped;
+	unsigned int sent;
+	int ret;
+
+	for (;;) {
+		mutex_lock(&dsi_panel->shadow_lock);
+		shadow->sent = 0;
+		shadow->skipped = 0;
+		ret = mipi_dsi_panel_run_seq(dsi_panel, &dsi_panel->init_seq);
+		if (!ret)
+			ret = mipi_dsi_panel_verify(dsi_panel);
+		/* The sequence or a reset may have changed it */
+		dsi_panel->bl_applied = -1;
+		sent = shadow->sent;
+		skipped = shadow->skipped;
+		mutex_unlock(&dsi_panel->shadow_lock);
+		if (!ret || resets++ == MIPI_DSI_PANEL_INIT_RESETS)
+			break;
+
+		/* Last resort, start over from a clean panel state */
+		dev_warn(&dsi->dev, "init failed (%d), resetting panel\n", ret);
+		mipi_dsi_panel_stats_inc(dsi_panel, &dsi_panel->stats.resets);
+		mipi_dsi_panel_reset(dsi_panel);
+	}
+	dsi_panel->initialized = !ret;
+
+	dev_dbg(&dsi->dev, "init sequence: %u commands sent, %u skipped\n", sent, skipped);
+	mutex_lock(&dsi_panel->stats_lock);
+	dsi_panel->stats.last_init_sent = sent;
+	dsi_panel->stats.last_init_skipped = skipped;
+	mutex_unlock(&dsi_panel->stats_lock);
+
+	mipi_dsi_panel_phase_done(dsi_panel, MIPI_DSI_PANEL_PHASE_INIT_SEQ, start, ret);
+
+	return ret;
+}
+
+/* The PPS first if DSC is used, sleep mode turns compression off */
+static int mipi_dsi_panel_sleep_out(struct mipi_dsi_panel *dsi_panel)
+{
+	int ret;
+
+	if (dsi_panel->dsi->dsc) {
+		ret = mipi_dsi_panel_dsc_start(dsi_panel);
+		if (ret)
+			return ret;
+	}
+
+	ret = mipi_dsi_panel_dcs(dsi_panel, MIPI_DCS_EXIT_SLEEP_MODE);
+	if (ret)
+		return ret;
+	mipi_dsi_panel_seq_delay(dsi_panel, MIPI_DCS_EXIT_SLEEP_MODE,
+				 MIPI_DSI_PANEL_SLEEP_OUT_DELAY);
+
+	return mipi_dsi_panel_dcs(dsi_panel, MIPI_DCS_SET_DISPLAY_ON);
+}
+
+/*
+ * Leave sleep mode if the panel kept its registers since the last time it was
+ * prepared, run the whole init sequence otherwise or if that fails.
+ */
+static int mipi_dsi_panel_wake(struct mipi_dsi_panel *dsi_panel)
+{
+	struct mipi_dsi_device *dsi = dsi_panel->dsi;
+	ktime_t start = ktime_get();
+	int ret;
+
+	if (!dsi_panel->initialized) {
+		ret = mipi_dsi_panel_init(dsi_panel);
+		goto out;
+	}
+
+	ret = mipi_dsi_panel_sleep_out(dsi_panel);
+	mipi_dsi_panel_phase_done(dsi_panel, MIPI_DSI_PANEL_PHASE_SLEEP_OUT, start, ret);
+	if (ret) {
+		dev_warn(&dsi->dev, "leaving sleep mode failed (%d), initializing again\n", ret);
+		mipi_dsi_panel_reset(dsi_panel);
+		ret = mipi_dsi_panel_init(dsi_panel);
+	}
+
+out:
+	if (!ret)
+		ret = mipi_dsi_panel_start(dsi_panel);
+
+	return ret;
+}
+
+/* Sleep out and display on, the power mode a healthy enabled panel reports */
+static const struct mipi_dsi_panel_reg_check mipi_dsi_panel_esd_power_mode = {
+	MIPI_DCS_GET_POWER_MODE, MIPI_DCS_POWER_MODE_SLEEP | MIPI_DCS_POWER_MODE_DISPLAY,
+	MIPI_DCS_POWER_MODE_SLEEP | MIPI_DCS_POWER_MODE_DISPLAY
+};
+
+/* One register read, the caller holds shadow_lock */
+static int mipi_dsi_panel_esd_check(struct mipi_dsi_panel *dsi_panel)
+{
+	const struct mipi_dsi_panel_reg_check *check = dsi_panel->desc->esd_check ?:
+						       &mipi_dsi_panel_esd_power_mode;
+	u8 val;
+	int ret;
+
+	lockdep_assert_held(&dsi_panel->shadow_lock);
+
+	ret = mipi_dsi_panel_dcs_read(dsi_panel, check->reg, &val);
+	if (ret)
+		return ret;
+
+	if ((val & check->mask) != check->val) {
+		dev_dbg(&dsi_panel->dsi->dev, "0x%02x is 0x%02x, expected 0x%02x\n",
+			check->reg, val & check->mask, check->val);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/* The panel may have lost registers without a reset, nothing the shadow holds is sure */
+static void mipi_dsi_panel_shadow_invalidate(struct mipi_dsi_panel *dsi_panel)
+{
+	struct mipi_dsi_panel_shadow *shadow = &dsi_panel->shadow;
+
+	lockdep_assert_held(&dsi_panel->shadow_lock);
+
+	shadow->num_regs = 0;
+	shadow->page_known = false;
+}
+
+static int mipi_dsi_panel_esd_step(struct mipi_dsi_panel *dsi_panel,
+				   enum mipi_dsi_panel_esd_step step)
+{
+	int ret;
+
+	mutex_lock(&dsi_panel->shadow_lock);
+	if (step == MIPI_DSI_PANEL_ESD_WAKE) {
+		ret = mipi_dsi_panel_sleep_out(dsi_panel);
+		mutex_unlock(&dsi_panel->shadow_lock);
+		return ret;
+	}
+
+	mipi_dsi_panel_shadow_invalidate(dsi_panel);
+	ret = mipi_dsi_panel_run_seq(dsi_panel, &dsi_panel->init_seq);
+	dsi_panel->bl_applied = -1;
+	mutex_unlock(&dsi_panel->shadow_lock);
+
+	if (!ret)
+		ret = mipi_dsi_panel_start(dsi_panel);
+	/* The sequence may have changed the brightness */
+	schedule_delayed_work(&dsi_panel->bl_work, 0);
+
+	return ret;
+}
+
+static void mipi_dsi_panel_esd_recover(struct mipi_dsi_panel *dsi_panel, int err)
+{
+	struct device *dev = &dsi_panel->dsi->dev;
+	ktime_t start = ktime_get();
+	enum mipi_dsi_panel_esd_step step;
+	int ret = err;
+
+	dev_warn(dev, "health check failed (%d), recovering\n", err);
+
+	for (step = 0; step < MIPI_DSI_PANEL_ESD_STEPS; step++) {
+		ret = mipi_dsi_panel_esd_step(dsi_panel, step);
+		if (!ret) {
+			mutex_lock(&dsi_panel->shadow_lock);
+			ret = mipi_dsi_panel_esd_check(dsi_panel);
+			mutex_unlock(&dsi_panel->shadow_lock);
+		}
+		if (!ret)
+			break;
+	}
+
+	if (!ret) {
+		dev_info(dev, "recovered by %s\n", mipi_dsi_panel_esd_step_names[step]);
+		mipi_dsi_panel_stats_inc(dsi_panel, &dsi_panel->stats.esd_recovered[step]);
+	} else {
+		dev_err(dev, "recovery failed (%d), trying again in %u ms\n", ret,
+			dsi_panel->esd_interval);
+		mipi_dsi_panel_stats_inc(dsi_panel, &dsi_panel->stats.esd_unrecovered);
+	}
+	mipi_dsi_panel_phase_done(dsi_panel, MIPI_DSI_PANEL_PHASE_ESD_RECOVERY, start, ret);
+}
+
+/*
+ * Only runs while the panel is enabled: enable queues it, disable and
+ * unprepare cancel it before touching the panel. All link access goes
+ * through shadow_lock, a check that would overlap other commands of the
+ * driver is retried shortly after instead of waiting for them.
+ */
+static void mipi_dsi_panel_esd_work(struct work_struct *work)
+{
+	struct mipi_dsi_panel *dsi_panel = container_of(to_delayed_work(work),
+							struct mipi_dsi_panel, esd_work);
+	unsigned int delay = dsi_panel->esd_interval;
+	int ret;
+
+	if (!mutex_trylock(&dsi_panel->shadow_lock)) {
+		delay = MIPI_DSI_PANEL_ESD_RETRY_MS;
+		goto out;
+	}
+	ret = mipi_dsi_panel_esd_check(dsi_panel);
+	mutex_unlock(&dsi_panel->shadow_lock);
+
+	mipi_dsi_panel_stats_inc(dsi_panel, &dsi_panel->stats.esd_checks);
+	if (ret) {
+		mipi_dsi_panel_stats_inc(dsi_panel, &dsi_panel->stats.esd_faults);
+		mipi_dsi_panel_esd_recover(dsi_panel, ret);
+	}
+
+out:
+	queue_delayed_work(system_power_efficient_wq, &dsi_panel->esd_work,
+			   msecs_to_jiffies(delay));
+}
+
+static int mipi_dsi_panel_runtime_suspend(struct device *dev)
 {
-	return container_of(panel, struct mipi_dsi_panel, panel);
+	struct mipi_dsi_panel *dsi_panel = dev_get_drvdata(dev);
+
+	gpiod_set_value(dsi_panel->reset, 0);
+	regulator_bulk_disable(dsi_panel->desc->num_supplies, dsi_panel->supplies);
+	dsi_panel->initialized = false;
+	mipi_dsi_panel_shadow_reset(dsi_panel);
+
+	return 0;
 }
 
-static inline int mipi_dsi_panel_dsi_write(struct mipi_dsi_device *dsi, const void *seq,
-				   size_t len)
-{
-	return mipi_dsi_dcs_write_buffer(dsi, seq, len);
-}
-
-#define MIPI_DSI_SEQ(dsi, seq...)				\
-	{							\
-		pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__); \
-		const u8 d[] = { seq };				\
-		mipi_dsi_panel_dsi_write(dsi, d, ARRAY_SIZE(d));	\
-	}
-
-static void ts070wsh02ce_init_sequence(struct mipi_dsi_device *dsi)
-{
-	MIPI_DSI_SEQ(dsi, 0x80, 0x8B);
-	MIPI_DSI_SEQ(dsi, 0x81, 0x78);
-	MIPI_DSI_SEQ(dsi, 0x82, 0x84);
-	MIPI_DSI_SEQ(dsi, 0x83, 0x88);
-	MIPI_DSI_SEQ(dsi, 0x84, 0xA8);
-	MIPI_DSI_SEQ(dsi, 0x85, 0xE3);
-	MIPI_DSI_SEQ(dsi, 0x86, 0x88);
-
-
-	MIPI_DSI_SEQ(dsi, MIPI_DCS_EXIT_SLEEP_MODE);
-	MIPI_DSI_SEQ(dsi, MIPI_DCS_SET_DISPLAY_ON);
-}
-
-
-static void wf70a8syahmngb_init_sequence(struct mipi_dsi_device *dsi)
-{
-	MIPI_DSI_SEQ(dsi, 0xB1, 0x30);
-	msleep(5);
-
-	MIPI_DSI_SEQ(dsi, 0x80, 0x5B);
-	MIPI_DSI_SEQ(dsi, 0x81, 0x47);
-	MIPI_DSI_SEQ(dsi, 0x82, 0x84);
-	MIPI_DSI_SEQ(dsi, 0x83, 0x88);
-	MIPI_DSI_SEQ(dsi, 0x84, 0x88);
-	MIPI_DSI_SEQ(dsi, 0x85, 0x23);
-	MIPI_DSI_SEQ(dsi, 0x86, 0xB6);
-
-
-	MIPI_DSI_SEQ(dsi, MIPI_DCS_EXIT_SLEEP_MODE);
-	MIPI_DSI_SEQ(dsi, MIPI_DCS_SET_DISPLAY_ON);
-}
-
-static void wf40eswaa6_init_sequence(struct mipi_dsi_device *dsi)
-{
-	MIPI_DSI_SEQ(dsi, 0x11);
-	msleep(120);
-
-	MIPI_DSI_SEQ(dsi, 0xFF, 0x77, 0x01, 0x00, 0x00, 0x10);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xC0, 0x3B, 0x00);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xC1, 0x0D, 0x02);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xC2, 0x30, 0x05);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xB0, 0x01, 0x08, 0x10, 0x0C, 0x10, 0x06, 0x07, 0x08, 0x07, 0x22, 0x04, 0x14, 0x12, 0xB3, 0x3A, 0x1F);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xB1, 0x13, 0x19, 0x1F, 0x0F, 0x14, 0x07, 0x07, 0x08, 0x07, 0x22, 0x02, 0x0F, 0x0F, 0xA3, 0x29, 0x0D);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xFF, 0x77, 0x01, 0x00, 0x00, 0x11);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xB0, 0x60);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xB1, 0x2D);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xB2, 0x07);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xB3, 0x80);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xB5, 0x49);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xB7, 0x85);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xB8, 0x21);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xC1, 0x78);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xC2, 0x78);
-	msleep(100);
-	MIPI_DSI_SEQ(dsi, 0xE0, 0x00, 0x28, 0x02);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xE1, 0x08, 0xA0, 0x00, 0x00, 0x07, 0xA0, 0x00, 0x00, 0x00, 0x44, 0x44);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xE2, 0x11, 0x11, 0x44, 0x44, 0xED, 0xA0, 0x00, 0x00, 0xEC, 0xA0, 0x00, 0x00);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xE3, 0x00, 0x00, 0x11, 0x11);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xE4, 0x44, 0x44);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xE5, 0x0A, 0xE9, 0xD8, 0xA0, 0x0C, 0xEB, 0xD8, 0xA0, 0x0E, 0xED, 0xD8, 0xA0, 0x10, 0xEF, 0xD8, 0xA0);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xE6, 0x00, 0x00, 0x11, 0x11);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xE7, 0x44, 0x44);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xE8, 0x09, 0xE8, 0xD8, 0xA0, 0x0B, 0xEA, 0xD8, 0xA0, 0x0D, 0xEC, 0xD8, 0xA0, 0x0F, 0xEE, 0xD8, 0xA0);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xEB, 0x00, 0x00, 0xE4, 0xE4, 0x88, 0x00, 0x40);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xEC, 0x3C, 0x00);
-	msleep(5);
-	MIPI_DSI_SEQ(dsi, 0xED, 0xAB, 0x89, 0x76, 0x54, 0x02, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x20, 0x45, 0x67, 0x98, 0xBA);
-	msleep(5);
-
-	MIPI_DSI_SEQ(dsi, 0x36, 0x00);
-
-	MIPI_DSI_SEQ(dsi, MIPI_DCS_EXIT_SLEEP_MODE);
-	MIPI_DSI_SEQ(dsi, MIPI_DCS_SET_DISPLAY_ON);
-}
-
-static void am4001280a3tzqw01h_init_sequence(struct mipi_dsi_device *dsi)
-{
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
-
-	MIPI_DSI_SEQ(dsi, 0xB0,0x5A);
-	MIPI_DSI_SEQ(dsi, 0xB1,0x00);
-	MIPI_DSI_SEQ(dsi, 0x89,0x01);
-	MIPI_DSI_SEQ(dsi, 0x91,0x07);
-	MIPI_DSI_SEQ(dsi, 0x92,0xF9);
-	MIPI_DSI_SEQ(dsi, 0xB1,0x03);
-	MIPI_DSI_SEQ(dsi, 0x2C,0x28);
-	MIPI_DSI_SEQ(dsi, 0x00,0xB7);
-	MIPI_DSI_SEQ(dsi, 0x01,0x1B);
-	MIPI_DSI_SEQ(dsi, 0x02,0x00);
-	MIPI_DSI_SEQ(dsi, 0x03,0x00);
-	MIPI_DSI_SEQ(dsi, 0x04,0x00);
-	MIPI_DSI_SEQ(dsi, 0x05,0x00);
-	MIPI_DSI_SEQ(dsi, 0x06,0x00);
-	MIPI_DSI_SEQ(dsi, 0x07,0x00);
-	MIPI_DSI_SEQ(dsi, 0x08,0x00);
-	MIPI_DSI_SEQ(dsi, 0x09,0x00);
-	MIPI_DSI_SEQ(dsi, 0x0A,0x01);
-	MIPI_DSI_SEQ(dsi, 0x0B,0x01);
-	MIPI_DSI_SEQ(dsi, 0x0C,0x20);
-	MIPI_DSI_SEQ(dsi, 0x0D,0x00);
-	MIPI_DSI_SEQ(dsi, 0x0E,0x24);
-	MIPI_DSI_SEQ(dsi, 0x0F,0x1C);
-	MIPI_DSI_SEQ(dsi, 0x10,0xC9);
-	MIPI_DSI_SEQ(dsi, 0x11,0x60);
-	MIPI_DSI_SEQ(dsi, 0x12,0x70);
-	MIPI_DSI_SEQ(dsi, 0x13,0x01);
-	MIPI_DSI_SEQ(dsi, 0x14,0xE7);
-	MIPI_DSI_SEQ(dsi, 0x15,0xFF);
-	MIPI_DSI_SEQ(dsi, 0x16,0x3D);
-	MIPI_DSI_SEQ(dsi, 0x17,0x0E);
-	MIPI_DSI_SEQ(dsi, 0x18,0x01);
-	MIPI_DSI_SEQ(dsi, 0x19,0x00);
-	MIPI_DSI_SEQ(dsi, 0x1A,0x00);
-	MIPI_DSI_SEQ(dsi, 0x1B,0xFC);
-	MIPI_DSI_SEQ(dsi, 0x1C,0x0B);
-	MIPI_DSI_SEQ(dsi, 0x1D,0xA0);
-	MIPI_DSI_SEQ(dsi, 0x1E,0x03);
-	MIPI_DSI_SEQ(dsi, 0x1F,0x04);
-	MIPI_DSI_SEQ(dsi, 0x20,0x0C);
-	MIPI_DSI_SEQ(dsi, 0x21,0x00);
-	MIPI_DSI_SEQ(dsi, 0x22,0x04);
-	MIPI_DSI_SEQ(dsi, 0x23,0x81);
-	MIPI_DSI_SEQ(dsi, 0x24,0x1F);
-	MIPI_DSI_SEQ(dsi, 0x25,0x10);
-	MIPI_DSI_SEQ(dsi, 0x26,0x9B);
-	MIPI_DSI_SEQ(dsi, 0x2D,0x01);
-	MIPI_DSI_SEQ(dsi, 0x2E,0x84);
-	MIPI_DSI_SEQ(dsi, 0x2F,0x00);
-	MIPI_DSI_SEQ(dsi, 0x30,0x02);
-	MIPI_DSI_SEQ(dsi, 0x31,0x08);
-	MIPI_DSI_SEQ(dsi, 0x32,0x01);
-	MIPI_DSI_SEQ(dsi, 0x33,0x1C);
-	MIPI_DSI_SEQ(dsi, 0x34,0x40);
-
-	MIPI_DSI_SEQ(dsi, MIPI_DCS_EXIT_SLEEP_MODE);
-	MIPI_DSI_SEQ(dsi, MIPI_DCS_SET_DISPLAY_ON);
-
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
-}
-
-static void top055fhd01a_init_sequence(struct mipi_dsi_device *dsi)
-{
-	/**
-	 * Temporarly turn on tranmission of data during low power mode,
-	 * this is another way of achiving it. It could also be set in the
-	 * panel_desc->flags.
-	 */
-	dsi->mode_flags |= MIPI_DSI_MODE_LPM;
-
-	MIPI_DSI_SEQ(dsi, 0xFE, 0x04);
-	MIPI_DSI_SEQ(dsi, 0x5E, 0x00);
-	MIPI_DSI_SEQ(dsi, 0x44, 0x47);
-	MIPI_DSI_SEQ(dsi, 0xFE, 0x07);
-	MIPI_DSI_SEQ(dsi, 0xA9, 0x6A);
-	MIPI_DSI_SEQ(dsi, 0xFE, 0x0A);
-	MIPI_DSI_SEQ(dsi, 0x14, 0x52);
-	MIPI_DSI_SEQ(dsi, 0xFE, 0x00);
-	MIPI_DSI_SEQ(dsi, 0x55, 0x00);
+static int mipi_dsi_panel_runtime_resume(struct device *dev)
+{
+	struct mipi_dsi_panel *dsi_panel = dev_get_drvdata(dev);
+	const struct mipi_dsi_panel_fast_delays *fast = dsi_panel->fast;
+	ktime_t start = ktime_get();
+	int ret;
 
-	/* Set video mode to send vsync and hsync pulse */
-	MIPI_DSI_SEQ(dsi, 0xC2, 0x03);
+	gpiod_set_value(dsi_panel->reset, 0);
+	mipi_dsi_panel_shadow_reset(dsi_panel);
 
-	MIPI_DSI_SEQ(dsi, 0x51, 0xFF);
+	ret = regulator_bulk_enable(dsi_panel->desc->num_supplies,
+				    dsi_panel->supplies);
+	if (ret < 0) {
+		mipi_dsi_panel_phase_done(dsi_panel, MIPI_DSI_PANEL_PHASE_REGULATORS, start, ret);
+		return ret;
+	}
+	mipi_dsi_panel_delay(dsi_panel, fast ? fast->power_on : 0, dsi_panel->power_on_delay);
+	mipi_dsi_panel_phase_done(dsi_panel, MIPI_DSI_PANEL_PHASE_REGULATORS, start, 0);
 
-	MIPI_DSI_SEQ(dsi, MIPI_DCS_EXIT_SLEEP_MODE);
-	msleep(500);
-	MIPI_DSI_SEQ(dsi, MIPI_DCS_SET_DISPLAY_ON);
-	msleep(100);
-	MIPI_DSI_SEQ(dsi, 0xFE, 0x07);
-	msleep(200);
-	MIPI_DSI_SEQ(dsi, 0xA9, 0xEA);
-	MIPI_DSI_SEQ(dsi, 0xFE, 0x00);
+	start = ktime_get();
+	gpiod_set_value(dsi_panel->reset, 1);
+	mipi_dsi_panel_delay(dsi_panel, fast ? fast->reset : 0, dsi_panel->reset_delay);
+	mipi_dsi_panel_phase_done(dsi_panel, MIPI_DSI_PANEL_PHASE_RESET, start, 0);
 
-	/* Read back all dsi registers we wrote above */
-#ifdef DEBUG
-	{
-		char buf[1];
+	return 0;
+}
 
-		mipi_dsi_dcs_read(dsi, 0x52, buf, 1);
-		pr_debug("%s - %s:%d: 0x52 = 0x%02x\n", __func__, __FILE__, __LINE__, buf[0]);
-		mipi_dsi_dcs_read(dsi, 0x54, buf, 1);
-		pr_debug("%s - %s:%d: 0x54 = 0x%02x\n", __func__, __FILE__, __LINE__, buf[0]);
+/*
+ * Without CONFIG_PM the runtime PM calls do nothing, the supplies are then
+ * switched right away and there is no autosuspend delay.
+ */
+static int mipi_dsi_panel_pm_get(struct mipi_dsi_panel *dsi_panel)
+{
+	if (!IS_ENABLED(CONFIG_PM))
+		return mipi_dsi_panel_runtime_resume(&dsi_panel->dsi->dev);
 
-		char id[3];
-		mipi_dsi_dcs_read(dsi, 0x04, id, 3);
-		pr_debug("%s - %s:%d: ID = 0x%02x%02x%02x\n", __func__, __FILE__, __LINE__, id[0], id[1], id[2]);
+	return pm_runtime_resume_and_get(&dsi_panel->dsi->dev);
+}
 
+static void mipi_dsi_panel_pm_put(struct mipi_dsi_panel *dsi_panel)
+{
+	if (!IS_ENABLED(CONFIG_PM)) {
+		mipi_dsi_panel_runtime_suspend(&dsi_panel->dsi->dev);
+		return;
 	}
-#endif /* DEBUG */
 
-	dsi->mode_flags &= MIPI_DSI_MODE_LPM;
+	pm_runtime_mark_last_busy(&dsi_panel->dsi->dev);
+	pm_runtime_put_autosuspend(&dsi_panel->dsi->dev);
 }
 
-static int mipi_dsi_panel_prepare(struct drm_panel *panel)
+/* Power, reset and, unless wait-until-enabled is set, init or wake the panel */
+static int mipi_dsi_panel_power_on(struct mipi_dsi_panel *dsi_panel)
 {
-	struct mipi_dsi_panel *dsi_panel = panel_to_dsi_panel(panel);
 	int ret;
 
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
-
-	gpiod_set_value(dsi_panel->reset, 0);
-
-	ret = regulator_bulk_enable(dsi_panel->desc->num_supplies,
-				    dsi_panel->supplies);
+	/*
+	 * The first prepare takes over the power-up started at probe. Else the
+	 * panel is only powered up if the autosuspend delay already expired.
+	 */
+	if (dsi_panel->async_init) {
+		wait_for_completion(&dsi_panel->power_done);
+		dsi_panel->async_init = false;
+		ret = dsi_panel->power_ret;
+	} else {
+		ret = mipi_dsi_panel_pm_get(dsi_panel);
+	}
 	if (ret < 0)
 		return ret;
-	msleep(20);
-
-	gpiod_set_value(dsi_panel->reset, 1);
-	msleep(150);
+	dsi_panel->powered = true;
 
 	/* Workaround for downstream NXP drivers */
 	if (!dsi_panel->wait_until_enabled) {
-		pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
-		dsi_panel->desc->init_sequence(dsi_panel->dsi);
+		ret = mipi_dsi_panel_wake(dsi_panel);
+		if (ret) {
+			/* There is no unprepare after a failed prepare */
+			mipi_dsi_panel_pm_put(dsi_panel);
+			dsi_panel->powered = false;
+			return ret;
+		}
 		dsi_panel->prepared = true;
 	}
 
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
-
 	return 0;
 }
 
-static int mipi_dsi_panel_enable(struct drm_panel *panel)
+/*
+ * Only needs the supplies and the reset GPIO, not the DSI host, so it can
+ * overlap the rest of the pipeline (bridges, encoder, fbdev) being set up.
+ */
+static void mipi_dsi_panel_power_work(struct work_struct *work)
+{
+	struct mipi_dsi_panel *dsi_panel = container_of(work, struct mipi_dsi_panel,
+							power_work);
+
+	dsi_panel->power_ret = mipi_dsi_panel_pm_get(dsi_panel);
+	complete_all(&dsi_panel->power_done);
+}
+
+static int mipi_dsi_panel_prepare(struct drm_panel *panel)
 {
 	struct mipi_dsi_panel *dsi_panel = panel_to_dsi_panel(panel);
 
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
+	return mipi_dsi_panel_power_on(dsi_panel);
+}
+
+static int mipi_dsi_panel_enable(struct drm_panel *panel)
+{
+	struct mipi_dsi_panel *dsi_panel = panel_to_dsi_panel(panel);
+	ktime_t start = ktime_get();
+	int ret = 0;
 
 	if (dsi_panel->wait_until_enabled) {
-		pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
-		dsi_panel->desc->init_sequence(dsi_panel->dsi);
+		ret = mipi_dsi_panel_wake(dsi_panel);
+		if (ret)
+			goto out;
 		dsi_panel->prepared = true;
 	}
 
 	backlight_enable(dsi_panel->backlight);
 
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
+	if (dsi_panel->esd_interval)
+		queue_delayed_work(system_power_efficient_wq, &dsi_panel->esd_work,
+				   msecs_to_jiffies(dsi_panel->esd_interval));
 
-	return 0;
+out:
+	mipi_dsi_panel_phase_done(dsi_panel, MIPI_DSI_PANEL_PHASE_ENABLE, start, ret);
+
+	return ret;
 }
 
 static int mipi_dsi_panel_disable(struct drm_panel *panel)
 {
 	struct mipi_dsi_panel *dsi_panel = panel_to_dsi_panel(panel);
 
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
-
+	/* Lets a running recovery finish, the panel is turned off anyway */
+	cancel_delayed_work_sync(&dsi_panel->esd_work);
 	backlight_disable(dsi_panel->backlight);
+	/* Send the brightness of 0 now instead of after display off */
+	flush_delayed_work(&dsi_panel->bl_work);
 
-	MIPI_DSI_SEQ(dsi_panel->dsi, MIPI_DCS_SET_DISPLAY_OFF);
-	MIPI_DSI_SEQ(dsi_panel->dsi, MIPI_DCS_ENTER_SLEEP_MODE);
+	mipi_dsi_panel_dcs(dsi_panel, MIPI_DCS_SET_DISPLAY_OFF);
+	mipi_dsi_panel_dcs(dsi_panel, MIPI_DCS_ENTER_SLEEP_MODE);
 
 	msleep(dsi_panel->sleep_delay);
 
 
 	if (dsi_panel->wait_until_enabled) {
-		pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
-		MIPI_DSI_SEQ(dsi_panel->dsi, MIPI_DCS_ENTER_SLEEP_MODE);
+		mipi_dsi_panel_dcs(dsi_panel, MIPI_DCS_ENTER_SLEEP_MODE);
 		msleep(dsi_panel->sleep_delay);
 	}
 
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
-
 	return 0;
 }
 
@@ -358,29 +2077,37 @@ static int mipi_dsi_panel_unprepare(struct drm_panel *panel)
 {
 	struct mipi_dsi_panel *dsi_panel = panel_to_dsi_panel(panel);
 
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
-
 	dsi_panel->prepared = false;
+	cancel_delayed_work_sync(&dsi_panel->esd_work);
+	cancel_delayed_work_sync(&dsi_panel->bl_work);
+	if (!dsi_panel->powered)
+		return 0;
+
 	if (!dsi_panel->wait_until_enabled) {
-		pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
-		MIPI_DSI_SEQ(dsi_panel->dsi, MIPI_DCS_ENTER_SLEEP_MODE);
+		mipi_dsi_panel_dcs(dsi_panel, MIPI_DCS_ENTER_SLEEP_MODE);
 		msleep(dsi_panel->sleep_delay);
 	}
 
-	gpiod_set_value(dsi_panel->reset, 0);
-
-	regulator_bulk_disable(dsi_panel->desc->num_supplies, dsi_panel->supplies);
-
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
+	/*
+	 * Keep the supplies on in sleep mode for a while, unblanking again
+	 * then only needs to leave sleep mode instead of a full init.
+	 */
+	mipi_dsi_panel_pm_put(dsi_panel);
+	dsi_panel->powered = false;
 
 	return 0;
 }
 
+static const struct dev_pm_ops mipi_dsi_panel_pm_ops = {
+	SET_RUNTIME_PM_OPS(mipi_dsi_panel_runtime_suspend, mipi_dsi_panel_runtime_resume, NULL)
+	SET_SYSTEM_SLEEP_PM_OPS(pm_runtime_force_suspend, pm_runtime_force_resume)
+};
+
 static int mipi_dsi_panel_get_modes(struct drm_panel *panel,
 		struct drm_connector *connector)
 {
 	struct mipi_dsi_panel *dsi_panel = panel_to_dsi_panel(panel);
-	const struct drm_display_mode *desc_mode = dsi_panel->desc->mode;
+	const struct drm_display_mode *desc_mode = dsi_panel->mode;
 	struct drm_display_mode *mode;
 
 	mode = drm_mode_duplicate(connector->dev, desc_mode);
@@ -401,6 +2128,442 @@ static int mipi_dsi_panel_get_modes(struct drm_panel *panel,
 	return 1;
 }
 
+static int mipi_dsi_panel_stats_show(struct seq_file *s, void *data)
+{
+	struct mipi_dsi_panel *dsi_panel = s->private;
+	struct mipi_dsi_panel_stats *stats = &dsi_panel->stats;
+	const struct drm_display_mode *mode = dsi_panel->mode;
+	struct mipi_dsi_panel_phase_stats *phase;
+	int i;
+
+	mutex_lock(&dsi_panel->stats_lock);
+
+	seq_printf(s, "%-12s %8s %8s %10s %10s %10s\n", "phase", "count", "errors",
+		   "last_us", "max_us", "avg_us");
+	for (i = 0; i < MIPI_DSI_PANEL_NUM_PHASES; i++) {
+		phase = &stats->phases[i];
+		seq_printf(s, "%-12s %8llu %8llu %10llu %10llu %10llu\n",
+			   mipi_dsi_panel_phase_names[i], phase->count, phase->errors,
+			   phase->last_us, phase->max_us,
+			   phase->count ? div64_u64(phase->total_us, phase->count) : 0);
+	}
+
+	seq_printf(s, "\nbursts: %llu\nwrites: %llu\nwrite errors: %llu\nretries: %llu\n",
+		   stats->bursts, stats->writes, stats->write_errors, stats->retries);
+	seq_printf(s, "verify errors: %llu\nresets: %llu\n", stats->verify_errors,
+		   stats->resets);
+	seq_printf(s, "skipped writes: %llu\nlast init: %u sent, %u skipped\n",
+		   stats->skipped, stats->last_init_sent, stats->last_init_skipped);
+	seq_printf(s, "brightness requests: %llu, writes: %llu\n", stats->bl_requests,
+		   stats->bl_writes);
+	seq_printf(s, "health checks: %llu, faults: %llu, unrecovered: %llu\n",
+		   stats->esd_checks, stats->esd_faults, stats->esd_unrecovered);
+	for (i = 0; i < MIPI_DSI_PANEL_ESD_STEPS; i++)
+		seq_printf(s, "  recovered by %s: %llu\n", mipi_dsi_panel_esd_step_names[i],
+			   stats->esd_recovered[i]);
+	seq_printf(s, "mode: %ux%u@%u, %llu link bytes/s\n",
+		   mode->hdisplay, mode->vdisplay, drm_mode_vrefresh(mode),
+		   div64_u64(mipi_dsi_panel_video_bytes(dsi_panel) * mode->clock * 1000,
+			     mode->htotal * mode->vtotal));
+	for (i = 0; i < ARRAY_SIZE(stats->cmd_errors); i++) {
+		if (stats->cmd_errors[i])
+			seq_printf(s, "  cmd 0x%02x: %u\n", i, stats->cmd_errors[i]);
+	}
+
+	mutex_unlock(&dsi_panel->stats_lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(mipi_dsi_panel_stats);
+
+/* One line per cached register: [page] register value */
+static int mipi_dsi_panel_registers_show(struct seq_file *s, void *data)
+{
+	struct mipi_dsi_panel *dsi_panel = s->private;
+	struct mipi_dsi_panel_shadow *shadow = &dsi_panel->shadow;
+	struct mipi_dsi_panel_shadow_reg *entry;
+	unsigned int i;
+
+	mutex_lock(&dsi_panel->shadow_lock);
+
+	if (shadow->page_known)
+		seq_printf(s, "# page command 0x%02x, current [%*ph]\n",
+			   dsi_panel->desc->page_cmd, shadow->page.len, shadow->page.sel);
+	else
+		seq_printf(s, "# page command 0x%02x, current unknown\n",
+			   dsi_panel->desc->page_cmd);
+
+	for (i = 0; i < shadow->num_regs; i++) {
+		entry = &shadow->regs[i];
+		seq_printf(s, "[%*ph] %*ph\n", entry->page.len, entry->page.sel, entry->len,
+			   entry->data);
+	}
+
+	mutex_unlock(&dsi_panel->shadow_lock);
+
+	return 0;
+}
+
+static int mipi_dsi_panel_registers_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mipi_dsi_panel_registers_show, inode->i_private);
+}
+
+/*
+ * Writing hex bytes, e.g. "c0 3b 00", sends them as one command on the current
+ * page, including page commands. Nothing is sent if the shadow already holds
+ * the value.
+ */
+static ssize_t mipi_dsi_panel_registers_write(struct file *file, const char __user *ubuf,
+					      size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct mipi_dsi_panel *dsi_panel = s->private;
+	u8 data[MIPI_DSI_PANEL_SHADOW_REG_LEN];
+	char buf[128];
+	char *p = buf;
+	char *tok;
+	u8 len = 0;
+	int ret;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	while ((tok = strsep(&p, " \t\n"))) {
+		if (!*tok)
+			continue;
+		if (len == sizeof(data))
+			return -EINVAL;
+		ret = kstrtou8(tok, 16, &data[len++]);
+		if (ret)
+			return ret;
+	}
+	if (!len)
+		return -EINVAL;
+
+	if (!dsi_panel->prepared)
+		return -ENODEV;
+
+	ret = mipi_dsi_panel_write(dsi_panel, data, len);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations mipi_dsi_panel_registers_fops = {
+	.owner		= THIS_MODULE,
+	.open		= mipi_dsi_panel_registers_open,
+	.read		= seq_read,
+	.write		= mipi_dsi_panel_registers_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/* Relative to the start of the capture: time in us, r/w, length, result, bytes */
+static int mipi_dsi_panel_capture_show(struct seq_file *s, void *data)
+{
+	struct mipi_dsi_panel *dsi_panel = s->private;
+	struct mipi_dsi_panel_capture *rec;
+	unsigned int first;
+	unsigned int i;
+
+	mutex_lock(&dsi_panel->stats_lock);
+
+	first = dsi_panel->capture_count > MIPI_DSI_PANEL_CAPTURE_SIZE ?
+		dsi_panel->capture_count - MIPI_DSI_PANEL_CAPTURE_SIZE : 0;
+	seq_printf(s, "# %u transfers, %u dropped\n", dsi_panel->capture_count, first);
+	for (i = first; i < dsi_panel->capture_count; i++) {
+		rec = &dsi_panel->capture[i % MIPI_DSI_PANEL_CAPTURE_SIZE];
+		seq_printf(s, "%10lld %c %3u %4d %*ph%s\n",
+			   ktime_us_delta(rec->time, dsi_panel->capture_start),
+			   rec->read ? 'r' : 'w', rec->len, rec->ret,
+			   min_t(int, rec->len, MIPI_DSI_PANEL_CAPTURE_BYTES), rec->data,
+			   rec->len > MIPI_DSI_PANEL_CAPTURE_BYTES ? " ..." : "");
+	}
+
+	mutex_unlock(&dsi_panel->stats_lock);
+
+	return 0;
+}
+
+static int mipi_dsi_panel_capture_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mipi_dsi_panel_capture_show, inode->i_private);
+}
+
+/* Writing 1 clears the capture and starts recording, 0 stops it */
+static ssize_t mipi_dsi_panel_capture_write(struct file *file, const char __user *ubuf,
+					    size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct mipi_dsi_panel *dsi_panel = s->private;
+	bool on;
+	int ret;
+
+	ret = kstrtobool_from_user(ubuf, count, &on);
+	if (ret)
+		return ret;
+
+	if (on) {
+		mutex_lock(&dsi_panel->stats_lock);
+		dsi_panel->capture_count = 0;
+		dsi_panel->capture_start = ktime_get();
+		mutex_unlock(&dsi_panel->stats_lock);
+	}
+	WRITE_ONCE(dsi_panel->capturing, on);
+
+	return count;
+}
+
+static const struct file_operations mipi_dsi_panel_capture_fops = {
+	.owner		= THIS_MODULE,
+	.open		= mipi_dsi_panel_capture_open,
+	.read		= seq_read,
+	.write		= mipi_dsi_panel_capture_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/*
+ * Read all snapshot registers back to back, holding shadow_lock so no write
+ * gets in between. Nothing is sent if the panel is not prepared.
+ */
+static int mipi_dsi_panel_take_snapshot(struct mipi_dsi_panel *dsi_panel)
+{
+	struct mipi_dsi_panel_snapshot snap = { };
+	unsigned int i;
+
+	if (!dsi_panel->prepared)
+		return -ENODEV;
+
+	mutex_lock(&dsi_panel->shadow_lock);
+	snap.time = ktime_get();
+	for (i = 0; i < dsi_panel->num_snapshot_regs; i++) {
+		if (mipi_dsi_panel_dcs_read(dsi_panel, dsi_panel->snapshot_regs[i], &snap.val[i]))
+			snap.failed |= BIT(i);
+	}
+	mutex_unlock(&dsi_panel->shadow_lock);
+
+	mutex_lock(&dsi_panel->stats_lock);
+	if (dsi_panel->num_snapshots == MIPI_DSI_PANEL_SNAPSHOTS) {
+		memmove(&dsi_panel->snapshots[1], &dsi_panel->snapshots[2],
+			(MIPI_DSI_PANEL_SNAPSHOTS - 2) * sizeof(snap));
+		dsi_panel->num_snapshots--;
+	}
+	dsi_panel->snapshots[dsi_panel->num_snapshots++] = snap;
+	mutex_unlock(&dsi_panel->stats_lock);
+
+	return snap.failed == GENMASK(dsi_panel->num_snapshot_regs - 1, 0) ? -EIO : 0;
+}
+
+/* One line per snapshot, time in ms since boot and the values, -- if a read failed */
+static int mipi_dsi_panel_snapshots_show(struct seq_file *s, void *data)
+{
+	struct mipi_dsi_panel *dsi_panel = s->private;
+	struct mipi_dsi_panel_snapshot *snap;
+	unsigned int i, j;
+
+	seq_puts(s, "#      time");
+	for (j = 0; j < dsi_panel->num_snapshot_regs; j++)
+		seq_printf(s, " %02x", dsi_panel->snapshot_regs[j]);
+	seq_putc(s, '\n');
+
+	mutex_lock(&dsi_panel->stats_lock);
+	for (i = 0; i < dsi_panel->num_snapshots; i++) {
+		snap = &dsi_panel->snapshots[i];
+		seq_printf(s, "%11lld", ktime_to_ms(snap->time));
+		for (j = 0; j < dsi_panel->num_snapshot_regs; j++) {
+			if (snap->failed & BIT(j))
+				seq_puts(s, " --");
+			else
+				seq_printf(s, " %02x", snap->val[j]);
+		}
+		seq_putc(s, '\n');
+	}
+	mutex_unlock(&dsi_panel->stats_lock);
+
+	return 0;
+}
+
+static int mipi_dsi_panel_snapshots_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mipi_dsi_panel_snapshots_show, inode->i_private);
+}
+
+/* Writing 1 takes a snapshot, 0 drops all of them including the baseline */
+static ssize_t mipi_dsi_panel_snapshots_write(struct file *file, const char __user *ubuf,
+					      size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct mipi_dsi_panel *dsi_panel = s->private;
+	bool take;
+	int ret;
+
+	ret = kstrtobool_from_user(ubuf, count, &take);
+	if (ret)
+		return ret;
+
+	if (take) {
+		ret = mipi_dsi_panel_take_snapshot(dsi_panel);
+		return ret ? ret : count;
+	}
+
+	mutex_lock(&dsi_panel->stats_lock);
+	dsi_panel->num_snapshots = 0;
+	mutex_unlock(&dsi_panel->stats_lock);
+
+	return count;
+}
+
+static const struct file_operations mipi_dsi_panel_snapshots_fops = {
+	.owner		= THIS_MODULE,
+	.open		= mipi_dsi_panel_snapshots_open,
+	.read		= seq_read,
+	.write		= mipi_dsi_panel_snapshots_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/* The registers of each snapshot that differ from the baseline */
+static int mipi_dsi_panel_diff_show(struct seq_file *s, void *data)
+{
+	struct mipi_dsi_panel *dsi_panel = s->private;
+	struct mipi_dsi_panel_snapshot *base = &dsi_panel->snapshots[0];
+	struct mipi_dsi_panel_snapshot *snap;
+	unsigned int changed;
+	unsigned int i, j;
+	u8 reg;
+
+	mutex_lock(&dsi_panel->stats_lock);
+	for (i = 1; i < dsi_panel->num_snapshots; i++) {
+		snap = &dsi_panel->snapshots[i];
+		changed = 0;
+		seq_printf(s, "%lld ms after the baseline:",
+			   ktime_ms_delta(snap->time, base->time));
+		for (j = 0; j < dsi_panel->num_snapshot_regs; j++) {
+			reg = dsi_panel->snapshot_regs[j];
+			if ((snap->failed ^ base->failed) & BIT(j)) {
+				seq_printf(s, " %02x %s", reg,
+					   snap->failed & BIT(j) ? "unreadable" : "readable");
+				changed++;
+			} else if (!(snap->failed & BIT(j)) && snap->val[j] != base->val[j]) {
+				seq_printf(s, " %02x %02x->%02x", reg, base->val[j], snap->val[j]);
+				changed++;
+			}
+		}
+		seq_puts(s, changed ? "\n" : " no change\n");
+	}
+	mutex_unlock(&dsi_panel->stats_lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(mipi_dsi_panel_diff);
+
+/* Like mipi_dsi_panel_delay(), msleep() sleeps one jiffy longer than asked */
+static unsigned int mipi_dsi_panel_model_delay(struct mipi_dsi_panel *dsi_panel,
+					       unsigned int fast_us, unsigned int ms)
+{
+	if (!dsi_panel->fast)
+		return jiffies_to_usecs(msecs_to_jiffies(ms) + 1);
+
+	return mipi_dsi_panel_fast_us(fast_us, ms * 1000);
+}
+
+/*
+ * Modelled bring-up from power off with the current sequence and delay
+ * policy, without touching the panel. Polled delays count with their timeout,
+ * the worst case, the shadow is not taken into account.
+ */
+static void mipi_dsi_panel_model(struct mipi_dsi_panel *dsi_panel,
+				 struct mipi_dsi_panel_model *model)
+{
+	const struct mipi_dsi_panel_fast_delays *fast = dsi_panel->fast;
+	const struct mipi_dsi_panel_seq *seq = &dsi_panel->init_seq;
+	unsigned int fast_us;
+	bool awake = false;
+	size_t pos = 0;
+	unsigned int ms;
+	u8 cmd = 0;
+	u8 len;
+
+	memset(model, 0, sizeof(*model));
+	model->power_on_us = mipi_dsi_panel_model_delay(dsi_panel, fast ? fast->power_on : 0,
+							dsi_panel->power_on_delay);
+	model->reset_us = mipi_dsi_panel_model_delay(dsi_panel, fast ? fast->reset : 0,
+						     dsi_panel->reset_delay);
+
+	while (pos < seq->len) {
+		len = seq->data[pos++];
+		if (!len) {
+			ms = get_unaligned_le16(&seq->data[pos]);
+			fast_us = fast && ms <= MIPI_DSI_PANEL_SHORT_DELAY &&
+				  cmd != MIPI_DCS_EXIT_SLEEP_MODE &&
+				  cmd != MIPI_DCS_SET_DISPLAY_ON ? fast->step : 0;
+			model->delay_us += mipi_dsi_panel_model_delay(dsi_panel, fast_us, ms);
+			pos += 2;
+			cmd = 0;
+			continue;
+		}
+
+		model->xfer_us += MIPI_DSI_PANEL_MODEL_CMD_US;
+		if (mipi_dsi_panel_burst_lp(dsi_panel, awake))
+			model->xfer_us += len * MIPI_DSI_PANEL_MODEL_LP_BYTE_NS / 1000;
+		cmd = len == 1 ? seq->data[pos] : 0;
+		if (cmd == MIPI_DCS_EXIT_SLEEP_MODE)
+			awake = true;
+		model->bytes += len;
+		pos += len;
+		model->cmds++;
+	}
+
+	model->total_us = model->power_on_us + model->reset_us + model->xfer_us +
+			  model->delay_us;
+}
+
+static int mipi_dsi_panel_model_show(struct seq_file *s, void *data)
+{
+	struct mipi_dsi_panel_model model;
+
+	mipi_dsi_panel_model(s->private, &model);
+
+	seq_printf(s, "power-on: %u us\nreset: %u us\n", model.power_on_us, model.reset_us);
+	seq_printf(s, "init: %u commands, %zu bytes, %u us transfer, %u us delays\n",
+		   model.cmds, model.bytes, model.xfer_us, model.delay_us);
+	seq_printf(s, "total: %u us\n", model.total_us);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(mipi_dsi_panel_model);
+
+#if MIPI_DSI_PANEL_DSC
+/* The DSC parameters and the PPS the panel gets, to compare with its datasheet */
+static int mipi_dsi_panel_dsc_show(struct seq_file *s, void *data)
+{
+	struct mipi_dsi_panel *dsi_panel = s->private;
+	const struct drm_dsc_config *dsc = &dsi_panel->dsc_config;
+	struct drm_dsc_picture_parameter_set pps;
+	const u8 *raw = (const u8 *)&pps;
+	unsigned int i;
+
+	if (!dsi_panel->dsi->dsc) {
+		seq_puts(s, "off\n");
+		return 0;
+	}
+
+	drm_dsc_pps_payload_pack(&pps, dsc);
+	seq_printf(s, "%ux%u in %u slices of %ux%u, %u bpc, %u bpp\n", dsc->pic_width,
+		   dsc->pic_height, dsc->slice_count, dsc->slice_width, dsc->slice_height,
+		   dsc->bits_per_component, dsc->bits_per_pixel >> 4);
+	for (i = 0; i < sizeof(pps); i += 16)
+		seq_printf(s, "%02x: %16ph\n", i, &raw[i]);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(mipi_dsi_panel_dsc);
+#endif
+
 static const struct drm_panel_funcs mipi_dsi_panel_funcs = {
 	.disable	= mipi_dsi_panel_disable,
 	.unprepare	= mipi_dsi_panel_unprepare,
@@ -491,7 +2654,7 @@ static const struct drm_display_mode am4001280a3tzqw01h_mode = {
 };
 
 static const struct drm_display_mode top055fhd01a_mode = {
-	/* The adapter is not able to handle higher pixel clocks */
+	/* The adapter is not able to handle higher pixel clocks, see max_lane_rate */
 	.clock		= 70000,
 
 	.hdisplay	= 1080,
@@ -511,6 +2674,30 @@ static const struct drm_display_mode top055fhd01a_mode = {
 	.flags = DRM_MODE_FLAG_PHSYNC | DRM_MODE_FLAG_PVSYNC,
 };
 
+/*
+ * ST7701S: reset is done 5 ms after releasing it, no delays are needed between
+ * the register writes and sleep out and display on can be read back. Leaving
+ * sleep mode takes 120 ms.
+ */
+static const struct mipi_dsi_panel_fast_delays wf40eswaa6mnn0_fast = {
+	.power_on = 10000,
+	.reset = 10000,
+	.sleep_out = 120000,
+	.step = 1000,
+	.poll_power_mode = true,
+};
+
+/* No datasheet minimum for sleep out, the 120 ms of the DCS spec apply */
+static const struct mipi_dsi_panel_fast_delays top055fhd01a_fast = {
+	.power_on = 10000,
+	.reset = 20000,
+	.sleep_out = 120000,
+	.poll_power_mode = true,
+};
+
+/* Only replace msleep() by usleep_range() for panels without known minimums */
+static const struct mipi_dsi_panel_fast_delays mipi_dsi_panel_default_fast = { };
+
 static const char * const ts8550b_supply_names[] = {
 	"VCC",
 	"IOVCC",
@@ -526,7 +2713,10 @@ static const struct mipi_dsi_panel_panel_desc wf40eswaa6mnn0_desc = {
 	.supply_names = ts8550b_supply_names,
 	.num_supplies = ARRAY_SIZE(ts8550b_supply_names),
 	.panel_sleep_delay = 200,
-	.init_sequence = wf40eswaa6_init_sequence,
+	.init_seq = MIPI_DSI_PANEL_SEQ(wf40eswaa6_init_seq),
+	.fast = &wf40eswaa6mnn0_fast,
+	.page_cmd = 0xFF,
+	.user_page = MIPI_DSI_PANEL_SEQ(wf40eswaa6_user_page),
 	.panel_has_backlight = false
 };
 
@@ -538,7 +2728,7 @@ static const struct mipi_dsi_panel_panel_desc wf70a8syahmngb_desc = {
 	.supply_names = ts8550b_supply_names,
 	.num_supplies = ARRAY_SIZE(ts8550b_supply_names),
 	.panel_sleep_delay = 200,
-	.init_sequence = wf70a8syahmngb_init_sequence,
+	.init_seq = MIPI_DSI_PANEL_SEQ(wf70a8syahmngb_init_seq),
 	.panel_has_backlight = false
 };
 
@@ -550,7 +2740,7 @@ static const struct mipi_dsi_panel_panel_desc ts070wsh02ce_desc= {
 	.supply_names = ts8550b_supply_names,
 	.num_supplies = ARRAY_SIZE(ts8550b_supply_names),
 	.panel_sleep_delay = 200,
-	.init_sequence = ts070wsh02ce_init_sequence,
+	.init_seq = MIPI_DSI_PANEL_SEQ(ts070wsh02ce_init_seq),
 	.panel_has_backlight = false
 };
 
@@ -562,7 +2752,7 @@ static const struct mipi_dsi_panel_panel_desc am4001280a3tzqw01h_desc= {
 	.supply_names = ts8550b_supply_names,
 	.num_supplies = ARRAY_SIZE(ts8550b_supply_names),
 	.panel_sleep_delay = 200,
-	.init_sequence = am4001280a3tzqw01h_init_sequence,
+	.init_seq = MIPI_DSI_PANEL_SEQ(am4001280a3tzqw01h_init_seq),
 	.panel_has_backlight = true
 };
 
@@ -574,63 +2764,103 @@ static const struct mipi_dsi_panel_panel_desc top055fhd01a_desc= {
 	.supply_names = ts8550b_supply_names,
 	.num_supplies = ARRAY_SIZE(ts8550b_supply_names),
 	.panel_sleep_delay = 200,
-	.init_sequence = top055fhd01a_init_sequence,
+	.init_seq = MIPI_DSI_PANEL_SEQ(top055fhd01a_init_seq),
+	.init_xfer = MIPI_DSI_PANEL_XFER_LP,
+	.verify = top055fhd01a_verify,
+	.num_verify = ARRAY_SIZE(top055fhd01a_verify),
+	.fast = &top055fhd01a_fast,
+	.page_cmd = 0xFE,
+	.user_page = MIPI_DSI_PANEL_SEQ(top055fhd01a_user_page),
+	.snapshot_regs = top055fhd01a_snapshot,
+	.num_snapshot_regs = ARRAY_SIZE(top055fhd01a_snapshot),
+	/* 70 MHz at 24 bpp on 4 lanes, the most the adapter was found to take */
+	.max_lane_rate = 420000,
 	.panel_has_backlight = false
 };
 
+/* The value last requested, it reaches the panel within a frame */
 static int mipi_dsi_bl_get_brightness(struct backlight_device *bl)
 {
 	struct mipi_dsi_device *dsi = bl_get_data(bl);
 	struct mipi_dsi_panel *panel = mipi_dsi_get_drvdata(dsi);
-	u16 brightness;
-	int ret;
-
-	if (!panel->prepared)
-		return -ENODEV;
-
-	ret = mipi_dsi_dcs_get_display_brightness(dsi, &brightness);
-	if (ret < 0)
-		return ret;
-
-	bl->props.brightness = brightness & 0xff;
 
-	return bl->props.brightness & 0xff;
+	return READ_ONCE(panel->brightness);
 }
 
+/*
+ * Only the newest value is sent, at most once per frame. Requests in between
+ * just update the value the pending work sends. While the panel is not
+ * prepared the value is kept for the next enable.
+ */
 static int mipi_dsi_bl_update_status(struct backlight_device *bl)
 {
 	struct mipi_dsi_device *dsi = bl_get_data(bl);
 	struct mipi_dsi_panel *panel = mipi_dsi_get_drvdata(dsi);
-	int ret = 0;
+	unsigned int vrefresh = drm_mode_vrefresh(panel->mode) ?: 60;
+	s64 wait_us;
 
-	if (!panel->prepared)
-		return -ENODEV;
+	WRITE_ONCE(panel->brightness, backlight_get_brightness(bl));
+	mipi_dsi_panel_stats_inc(panel, &panel->stats.bl_requests);
 
-	ret = mipi_dsi_dcs_set_display_brightness(dsi, bl->props.brightness);
-	if (ret < 0)
-		return ret;
+	wait_us = DIV_ROUND_UP(USEC_PER_SEC, vrefresh) -
+		  ktime_us_delta(ktime_get(), READ_ONCE(panel->bl_sent));
+	schedule_delayed_work(&panel->bl_work,
+			      wait_us > 0 ? usecs_to_jiffies(wait_us) : 0);
 
 	return 0;
 }
 
+static void mipi_dsi_bl_work(struct work_struct *work)
+{
+	struct mipi_dsi_panel *panel = container_of(to_delayed_work(work),
+						    struct mipi_dsi_panel, bl_work);
+	const struct mipi_dsi_panel_seq *user_page = &panel->desc->user_page;
+	u8 brightness = READ_ONCE(panel->brightness);
+	bool lp = mipi_dsi_panel_default_lp(panel);
+	/* The byte order of mipi_dsi_dcs_set_display_brightness() */
+	const u8 step[] = {
+		MIPI_DSI_SEQ_CMD(MIPI_DCS_SET_DISPLAY_BRIGHTNESS, brightness, 0),
+	};
+	u8 cmd;
+	int ret = 0;
+
+	if (!panel->prepared)
+		return;
+
+	mutex_lock(&panel->shadow_lock);
+	if (brightness != panel->bl_applied) {
+		/*
+		 * On paged panels 0x51 is only the brightness on the user
+		 * command set, the shadow skips the selection if it is current.
+		 */
+		if (panel->desc->page_cmd && user_page->len)
+			ret = mipi_dsi_panel_send_burst(panel, user_page->data, user_page->len,
+							lp, &cmd);
+		if (!ret)
+			ret = mipi_dsi_panel_send_burst(panel, step, sizeof(step), lp, &cmd);
+		panel->bl_applied = ret ? -1 : brightness;
+		WRITE_ONCE(panel->bl_sent, ktime_get());
+		mipi_dsi_panel_stats_inc(panel, &panel->stats.bl_writes);
+	}
+	mutex_unlock(&panel->shadow_lock);
+}
+
 static const struct backlight_ops mipi_dsi_bl_ops = {
 	.update_status = mipi_dsi_bl_update_status,
 	.get_brightness = mipi_dsi_bl_get_brightness,
 };
 
-static int mipi_dsi_panel_probe(struct mipi_dsi_device *dsi)
+static int mipi_dsi_panel_probe_desc(struct mipi_dsi_device *dsi,
+				     const struct mipi_dsi_panel_panel_desc *desc)
 {
-	const struct mipi_dsi_panel_panel_desc *desc;
 	struct mipi_dsi_panel *dsi_panel;
+	u32 autosuspend_delay;
 	int ret, i;
 
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
 	dsi_panel = devm_kzalloc(&dsi->dev, sizeof(*dsi_panel), GFP_KERNEL);
 	if (!dsi_panel)
 		return -ENOMEM;
 
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
-	desc = of_device_get_match_data(&dsi->dev);
 	dsi->mode_flags = desc->flags;
 	dsi->format = desc->format;
 	dsi->lanes = desc->lanes;
@@ -641,7 +2871,6 @@ static int mipi_dsi_panel_probe(struct mipi_dsi_device *dsi)
 	if (!dsi_panel->supplies)
 		return -ENOMEM;
 
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
 	for (i = 0; i < desc->num_supplies; i++)
 		dsi_panel->supplies[i].supply = desc->supply_names[i];
 
@@ -650,37 +2879,97 @@ static int mipi_dsi_panel_probe(struct mipi_dsi_device *dsi)
 	if (ret < 0)
 		return ret;
 
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
 	dsi_panel->reset = devm_gpiod_get(&dsi->dev, "reset", GPIOD_OUT_LOW);
 	if (IS_ERR(dsi_panel->reset)) {
 		DRM_DEV_ERROR(&dsi->dev, "Couldn't get our reset GPIO\n");
 		return PTR_ERR(dsi_panel->reset);
 	}
 
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
 	dsi_panel->backlight = devm_of_find_backlight(&dsi->dev);
 	if (IS_ERR(dsi_panel->backlight))
 		return PTR_ERR(dsi_panel->backlight);
 
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
+	dsi_panel->dsi = dsi;
+	dsi_panel->desc = desc;
+	dsi_panel->sleep_delay = desc->panel_sleep_delay;
+	dsi_panel->mode = desc->mode;
+	dsi_panel->init_seq = desc->init_seq;
+	dsi_panel->init_xfer = desc->init_xfer;
+	dsi_panel->cmd_mode = desc->cmd_mode;
+	/* Reading back costs time and needs a host that can read */
+	if (of_property_read_bool(dsi->dev.of_node, "verify-init")) {
+		dsi_panel->verify = desc->verify;
+		dsi_panel->num_verify = desc->num_verify;
+	}
+	if (desc->dsc)
+		dsi_panel->dsc = *desc->dsc;
+	dsi_panel->power_on_delay = MIPI_DSI_PANEL_POWER_ON_DELAY;
+	dsi_panel->reset_delay = MIPI_DSI_PANEL_RESET_DELAY;
+	if (desc->snapshot_regs) {
+		dsi_panel->snapshot_regs = desc->snapshot_regs;
+		dsi_panel->num_snapshot_regs = desc->num_snapshot_regs;
+	} else {
+		dsi_panel->snapshot_regs = mipi_dsi_panel_default_snapshot;
+		dsi_panel->num_snapshot_regs = ARRAY_SIZE(mipi_dsi_panel_default_snapshot);
+	}
+	mutex_init(&dsi_panel->shadow_lock);
+	mutex_init(&dsi_panel->stats_lock);
+	/* The backlight and drm_panel_add() make these reachable right away */
+	INIT_WORK(&dsi_panel->power_work, mipi_dsi_panel_power_work);
+	INIT_DELAYED_WORK(&dsi_panel->bl_work, mipi_dsi_bl_work);
+	INIT_DEFERRABLE_WORK(&dsi_panel->esd_work, mipi_dsi_panel_esd_work);
+	init_completion(&dsi_panel->power_done);
+	dsi_panel->wait_until_enabled = of_property_read_bool(dsi->dev.of_node,
+							"wait-until-enabled");
+	dsi_panel->async_init = of_property_read_bool(dsi->dev.of_node, "async-init");
+	of_property_read_u32(dsi->dev.of_node, "esd-check-interval-ms", &dsi_panel->esd_interval);
+	if (of_property_read_bool(dsi->dev.of_node, "fast-bring-up"))
+		dsi_panel->fast = desc->fast ?: &mipi_dsi_panel_default_fast;
 
-	drm_panel_init(&dsi_panel->panel, &dsi->dev, &mipi_dsi_panel_funcs, DRM_MODE_CONNECTOR_DSI);
+	ret = mipi_dsi_panel_load_firmware(dsi_panel);
+	if (ret)
+		return ret;
 
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
-	drm_panel_add(&dsi_panel->panel);
+	ret = mipi_dsi_panel_parse_dt(dsi_panel);
+	if (ret)
+		return ret;
+
+	/* The board says the host takes DSC, the host may still refuse it at attach */
+	if (of_property_read_bool(dsi->dev.of_node, "enable-dsc")) {
+		if (MIPI_DSI_PANEL_DSC)
+			dsi->dsc = &dsi_panel->dsc_config;
+		else
+			dev_warn(&dsi->dev, "DSC support is not built, ignoring enable-dsc\n");
+	}
+
+	ret = mipi_dsi_panel_check_modes(dsi_panel);
+	if (ret)
+		return ret;
+
+	ret = mipi_dsi_panel_shadow_alloc(dsi_panel);
+	if (ret)
+		return ret;
+
+	dsi_panel->capture = devm_kcalloc(&dsi->dev, MIPI_DSI_PANEL_CAPTURE_SIZE,
+					  sizeof(*dsi_panel->capture), GFP_KERNEL);
+	if (!dsi_panel->capture)
+		return -ENOMEM;
+
+	if (dsi_panel->cmd_mode)
+		dsi->mode_flags &= ~(MIPI_DSI_MODE_VIDEO | MIPI_DSI_MODE_VIDEO_BURST |
+				     MIPI_DSI_MODE_VIDEO_SYNC_PULSE | MIPI_DSI_MODE_VIDEO_HSE);
+
+	drm_panel_init(&dsi_panel->panel, &dsi->dev, &mipi_dsi_panel_funcs, DRM_MODE_CONNECTOR_DSI);
 
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
 	mipi_dsi_set_drvdata(dsi, dsi_panel);
-	dsi_panel->dsi = dsi;
-	dsi_panel->desc = desc;
-	dsi_panel->sleep_delay = desc->panel_sleep_delay;
 
 	if (desc->panel_has_backlight) {
-		pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
 		memset(&dsi_panel->bl_props, 0, sizeof(dsi_panel->bl_props));
 		dsi_panel->bl_props.type = BACKLIGHT_RAW;
-		dsi_panel->bl_props.brightness = 255;
 		dsi_panel->bl_props.max_brightness = 255;
+		dsi_panel->bl_props.brightness = dsi_panel->bl_props.max_brightness;
+		dsi_panel->brightness = dsi_panel->bl_props.brightness;
+		dsi_panel->bl_applied = -1;
 
 		dsi_panel->backlight = devm_backlight_device_register(&dsi->dev, dev_name(&dsi->dev),
 								  &dsi->dev, dsi, &mipi_dsi_bl_ops,
@@ -690,24 +2979,80 @@ static int mipi_dsi_panel_probe(struct mipi_dsi_device *dsi)
 			dev_err(&dsi->dev, "Failed to register backlight (%d)\n", ret);
 			return ret;
 		}
-
-		pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
 	}
 
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
-	dsi_panel->wait_until_enabled = of_property_read_bool(dsi->dev.of_node,
-							"wait-until-enabled");
+	drm_panel_add(&dsi_panel->panel);
+
+	dsi_panel->debugfs = debugfs_create_dir(dev_name(&dsi->dev),
+						mipi_dsi_panel_debugfs_root);
+	debugfs_create_file("stats", 0444, dsi_panel->debugfs, dsi_panel,
+			    &mipi_dsi_panel_stats_fops);
+	if (dsi_panel->shadow.regs)
+		debugfs_create_file("registers", 0644, dsi_panel->debugfs, dsi_panel,
+				    &mipi_dsi_panel_registers_fops);
+	debugfs_create_file("capture", 0644, dsi_panel->debugfs, dsi_panel,
+			    &mipi_dsi_panel_capture_fops);
+	debugfs_create_file("model", 0444, dsi_panel->debugfs, dsi_panel,
+			    &mipi_dsi_panel_model_fops);
+	debugfs_create_file("snapshots", 0644, dsi_panel->debugfs, dsi_panel,
+			    &mipi_dsi_panel_snapshots_fops);
+	debugfs_create_file("diff", 0444, dsi_panel->debugfs, dsi_panel,
+			    &mipi_dsi_panel_diff_fops);
+#if MIPI_DSI_PANEL_DSC
+	debugfs_create_file("dsc", 0444, dsi_panel->debugfs, dsi_panel,
+			    &mipi_dsi_panel_dsc_fops);
+#endif
+
+	/* The panel is off until the first prepare */
+	if (of_property_read_u32(dsi->dev.of_node, "autosuspend-delay-ms", &autosuspend_delay))
+		autosuspend_delay = MIPI_DSI_PANEL_AUTOSUSPEND_DELAY;
+	pm_runtime_set_autosuspend_delay(&dsi->dev, autosuspend_delay);
+	pm_runtime_use_autosuspend(&dsi->dev);
+	pm_runtime_enable(&dsi->dev);
+
+	/* Queued before attach, the host may prepare the panel right away */
+	if (dsi_panel->async_init)
+		queue_work(system_unbound_wq, &dsi_panel->power_work);
+
+	ret = mipi_dsi_attach(dsi);
+	/* Without DSC the mode has to fit into the lanes uncompressed */
+	if (ret && dsi->dsc) {
+		dev_warn(&dsi->dev, "host refused DSC (%d), trying without\n", ret);
+		dsi->dsc = NULL;
+		ret = mipi_dsi_panel_check_modes(dsi_panel);
+		if (!ret)
+			ret = mipi_dsi_attach(dsi);
+	}
+	if (ret) {
+		flush_work(&dsi_panel->power_work);
+		if (dsi_panel->async_init && dsi_panel->power_ret >= 0)
+			mipi_dsi_panel_pm_put(dsi_panel);
+		pm_runtime_disable(&dsi->dev);
+		pm_runtime_dont_use_autosuspend(&dsi->dev);
+		debugfs_remove_recursive(dsi_panel->debugfs);
+		drm_panel_remove(&dsi_panel->panel);
+	}
 
-	pr_debug("%s - %s:%d\n", __func__, __FILE__, __LINE__);
-	return mipi_dsi_attach(dsi);
+	return ret;
 }
 
 static void mipi_dsi_panel_remove(struct mipi_dsi_device *dsi)
 {
 	struct mipi_dsi_panel *dsi_panel = mipi_dsi_get_drvdata(dsi);
 
+	/* Drop the reference of a probe time power-up no prepare took over */
+	flush_work(&dsi_panel->power_work);
+	if (dsi_panel->async_init && dsi_panel->power_ret >= 0)
+		mipi_dsi_panel_pm_put(dsi_panel);
+	cancel_delayed_work_sync(&dsi_panel->esd_work);
+	cancel_delayed_work_sync(&dsi_panel->bl_work);
 	mipi_dsi_detach(dsi);
 	drm_panel_remove(&dsi_panel->panel);
+	debugfs_remove_recursive(dsi_panel->debugfs);
+
+	/* Power off now if the autosuspend delay did not expire yet */
+	pm_runtime_force_suspend(&dsi->dev);
+	pm_runtime_dont_use_autosuspend(&dsi->dev);
 }
 
 static const struct of_device_id mipi_dsi_panel_of_match[] = {
@@ -718,18 +3063,50 @@ static const struct of_device_id mipi_dsi_panel_of_match[] = {
 	{ .compatible = "wisecoco,top055fhd01a", .data = &top055fhd01a_desc},
 	{ }
 };
+
+/* panel-mipi-dsi-test.c includes this file and registers a driver of its own */
+#ifndef PANEL_MIPI_DSI_KUNIT
 MODULE_DEVICE_TABLE(of, mipi_dsi_panel_of_match);
 
+static int mipi_dsi_panel_probe(struct mipi_dsi_device *dsi)
+{
+	return mipi_dsi_panel_probe_desc(dsi, of_device_get_match_data(&dsi->dev));
+}
+
 static struct mipi_dsi_driver mipi_dsi_panel_dsi_driver = {
 	.probe		= mipi_dsi_panel_probe,
 	.remove		= mipi_dsi_panel_remove,
 	.driver = {
 		.name		= "mipi-dsi-panel",
 		.of_match_table	= mipi_dsi_panel_of_match,
+		.probe_type	= PROBE_PREFER_ASYNCHRONOUS,
+		.pm		= &mipi_dsi_panel_pm_ops,
 	},
 };
-module_mipi_dsi_driver(mipi_dsi_panel_dsi_driver);
+
+/* The stats of all panels live in debugfs under panel-mipi-dsi/<device> */
+static int __init mipi_dsi_panel_module_init(void)
+{
+	int ret;
+
+	mipi_dsi_panel_debugfs_root = debugfs_create_dir("panel-mipi-dsi", NULL);
+
+	ret = mipi_dsi_driver_register(&mipi_dsi_panel_dsi_driver);
+	if (ret)
+		debugfs_remove_recursive(mipi_dsi_panel_debugfs_root);
+
+	return ret;
+}
+module_init(mipi_dsi_panel_module_init);
+
+static void __exit mipi_dsi_panel_module_exit(void)
+{
+	mipi_dsi_driver_unregister(&mipi_dsi_panel_dsi_driver);
+	debugfs_remove_recursive(mipi_dsi_panel_debugfs_root);
+}
+module_exit(mipi_dsi_panel_module_exit);
 
 MODULE_AUTHOR("Stefan Eichenberger <stefan@embear.ch>");
 MODULE_DESCRIPTION("MIPI DSI sample driver supporting various panels");
 MODULE_LICENSE("GPL");
+#endif /* PANEL_MIPI_DSI_KUNIT */